@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+/**
+ * Preloaded by run_workload to count the heap allocations of a run. The
+ * calls are forwarded to the glibc allocator, and the totals are written
+ * at exit to the file named by BENCH_ALLOC_STATS.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *block, size_t size);
+
+static unsigned long long allocations;
+static unsigned long long allocated_bytes;
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocated_bytes, size, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocated_bytes, count * size, __ATOMIC_RELAXED);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *block, size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocated_bytes, size, __ATOMIC_RELAXED);
+	return __libc_realloc(block, size);
+}
+
+__attribute__((destructor))
+static void write_alloc_stats(void)
+{
+	const char *path = getenv("BENCH_ALLOC_STATS");
+	if (!path)
+		return;
+
+	FILE *stats = fopen(path, "w");
+	if (!stats)
+		return;
+	fprintf(stats, "%llu %llu\n", allocations, allocated_bytes);
+	fclose(stats);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+/**
+ * Measures the latency of every ht_put() while a chained and then an open
+ * addressing table grow from a handful of slots to a million keys, and
+ * prints the percentiles of each window of insertions. Incremental resizing
+ * shows in the p99.9 and the max, which otherwise pay for moving the whole
+ * table; building with -DHT_REHASH_STEP=UINT_MAX
+ * -DSWISS_MIGRATE_STEP=UINT_MAX moves it at once, for comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../hash_table.h"
+#include "../utils.h"
+
+#define BENCH_KEYS      (1u << 20)
+#define BENCH_WINDOWS   16
+#define BENCH_BUCKETS   16
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+	return (x > y) - (x < y);
+}
+
+static unsigned long long percentile(unsigned long long *sorted,
+									 unsigned int count, double p)
+{
+	unsigned int index = (unsigned int)(p * (count - 1));
+	return sorted[index];
+}
+
+static void bench_puts(const char *name, hashtable_t *ht,
+					   unsigned long long *latencies)
+{
+	char key[32];
+
+	for (unsigned int i = 0; i < BENCH_KEYS; i++)
+	{
+		snprintf(key, sizeof(key), "document-%u", i);
+		unsigned long long start = now_ns();
+		ht_put(ht, key, strlen(key) + 1, &i, sizeof(i));
+		latencies[i] = now_ns() - start;
+	}
+
+	printf("%s\n", name);
+	printf("%-10s %-10s %-10s %-10s %-10s\n",
+		   "keys", "p50_ns", "p99_ns", "p999_ns", "max_ns");
+
+	unsigned int window = BENCH_KEYS / BENCH_WINDOWS;
+	for (unsigned int w = 0; w < BENCH_WINDOWS; w++)
+	{
+		unsigned long long *slice = latencies + w * window;
+		qsort(slice, window, sizeof(unsigned long long), compare_latencies);
+		printf("%-10u %-10llu %-10llu %-10llu %-10llu\n",
+			   (w + 1) * window,
+			   percentile(slice, window, 0.50),
+			   percentile(slice, window, 0.99),
+			   percentile(slice, window, 0.999),
+			   slice[window - 1]);
+	}
+	printf("final slots: %u, size: %u\n", ht_get_hmax(ht), ht_get_size(ht));
+}
+
+int main(void)
+{
+	unsigned long long *latencies =
+	malloc(BENCH_KEYS * sizeof(unsigned long long));
+	DIE(!latencies, "malloc failed");
+
+	printf("rehash_step=%u migrate_step=%u\n", (unsigned int)HT_REHASH_STEP,
+		   (unsigned int)SWISS_MIGRATE_STEP);
+
+	hashtable_t *ht = ht_create(BENCH_BUCKETS, hash_string, compare_strings,
+								ht_free_key_val_function);
+	bench_puts("chained", ht, latencies);
+	ht_free(ht);
+
+	ht = ht_create_open(BENCH_BUCKETS, sizeof(unsigned int), hash_string,
+						compare_strings);
+	bench_puts("open", ht, latencies);
+	ht_free(ht);
+
+	free(latencies);
+	return 0;
+}
@@ -0,0 +1,620 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+/**
+ * Microbenchmarks of the data structures on the request path, linked with
+ * the object files of tema2. Every case runs a batch of operations per
+ * sample: the warmup samples are discarded, the timed ones give the
+ * percentiles of the nanoseconds per operation. One CSV line is printed
+ * per case.
+ *
+ *   microbench [-w warmup] [-r repetitions] [-f name_filter]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../hash_table.h"
+#include "../lru_cache.h"
+#include "../output.h"
+#include "../queue.h"
+#include "../load_balancer.h"
+#include "../server.h"
+#include "../utils.h"
+
+#define KEY_LENGTH          16
+#define HT_SLOTS            (1u << 16)
+#define HT_BATCH            (HT_SLOTS / 64)
+#define CACHE_CAPACITY      1024
+#define CACHE_OPS           (1u << 16)
+#define QUEUE_BATCH         1024
+#define LOOKUP_OPS          4096
+#define FILL_KEYS           (HT_SLOTS / 2)
+
+typedef struct bench_case
+{
+	const char *name;
+	char param[64];
+	unsigned int ops;
+	void *state;
+	// prepares the state of a sample, untimed; may be NULL
+	void (*prepare)(void *state);
+	void (*run)(void *state);
+} bench_case;
+
+static unsigned int warmup = 3;
+static unsigned int repetitions = 30;
+static const char *filter;
+static unsigned long long rng_state = 1;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned int next_random(void)
+{
+	// xorshift64*, only the spread of the keys matters here
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned int)((rng_state * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(double *sorted, unsigned int count, double p)
+{
+	return sorted[(unsigned int)(p * (count - 1))];
+}
+
+static bool bench_selected(const char *name)
+{
+	return !filter || strstr(name, filter);
+}
+
+static void run_case(bench_case *bench)
+{
+	double *samples = malloc(repetitions * sizeof(double));
+	DIE(!samples, "malloc failed");
+
+	for (unsigned int i = 0; i < warmup + repetitions; i++)
+	{
+		if (bench->prepare)
+			bench->prepare(bench->state);
+		unsigned long long start = now_ns();
+		bench->run(bench->state);
+		unsigned long long elapsed = now_ns() - start;
+		if (i >= warmup)
+			samples[i - warmup] = (double)elapsed / bench->ops;
+	}
+
+	double sum = 0;
+	for (unsigned int i = 0; i < repetitions; i++)
+		sum += samples[i];
+	qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+	printf("%s,%s,%u,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", bench->name,
+		   bench->param, bench->ops, repetitions, samples[0],
+		   percentile(samples, repetitions, 0.50),
+		   percentile(samples, repetitions, 0.90),
+		   percentile(samples, repetitions, 0.99),
+		   samples[repetitions - 1], sum / repetitions);
+	fflush(stdout);
+	free(samples);
+}
+
+static char (*create_keys(const char *prefix, unsigned int count))[KEY_LENGTH]
+{
+	char (*keys)[KEY_LENGTH] = malloc(count * sizeof(*keys));
+	DIE(!keys, "malloc failed");
+	for (unsigned int i = 0; i < count; i++)
+		snprintf(keys[i], KEY_LENGTH, "%s%u", prefix, i);
+	return keys;
+}
+
+static unsigned int *create_indices(unsigned int count, unsigned int bound)
+{
+	unsigned int *indices = malloc(count * sizeof(unsigned int));
+	DIE(!indices, "malloc failed");
+	for (unsigned int i = 0; i < count; i++)
+		indices[i] = next_random() % bound;
+	return indices;
+}
+
+/**
+ * Hash tables filled to a load factor of their buckets (chained) or slots
+ * (open addressing). The batch of keys put and removed by a sample keeps
+ * the load factor below the growth threshold of both tables.
+ */
+typedef struct ht_bench
+{
+	hashtable_t *ht;
+	char (*keys)[KEY_LENGTH];
+	char (*batch)[KEY_LENGTH];
+	unsigned int *lookups;
+	unsigned int size;
+} ht_bench;
+
+static void ht_bench_remove_batch(void *state)
+{
+	ht_bench *bench = state;
+	for (unsigned int i = 0; i < HT_BATCH; i++)
+		ht_remove_entry(bench->ht, bench->batch[i]);
+}
+
+static void ht_bench_put_batch(void *state)
+{
+	ht_bench *bench = state;
+	for (unsigned int i = 0; i < HT_BATCH; i++)
+		ht_put(bench->ht, bench->batch[i], KEY_LENGTH, &i, sizeof(i));
+}
+
+static void ht_bench_get_hit(void *state)
+{
+	ht_bench *bench = state;
+	for (unsigned int i = 0; i < LOOKUP_OPS; i++)
+		ht_get(bench->ht, bench->keys[bench->lookups[i]]);
+}
+
+static void ht_bench_get_miss(void *state)
+{
+	ht_bench *bench = state;
+	for (unsigned int i = 0; i < HT_BATCH; i++)
+		ht_get(bench->ht, bench->batch[i]);
+}
+
+static void bench_hash_tables(void)
+{
+	static const double loads[] = {0.25, 0.50, 0.75, 0.85};
+	char (*keys)[KEY_LENGTH] = create_keys("key-", HT_SLOTS);
+	char (*batch)[KEY_LENGTH] = create_keys("batch-", HT_BATCH);
+
+	for (unsigned int open = 0; open < 2; open++)
+	{
+		for (unsigned int l = 0; l < sizeof(loads) / sizeof(loads[0]); l++)
+		{
+			ht_bench bench;
+			bench.keys = keys;
+			bench.batch = batch;
+			bench.size = (unsigned int)(loads[l] * HT_SLOTS);
+			bench.lookups = create_indices(LOOKUP_OPS, bench.size);
+			// an open table asked for 7/8 of its slots gets exactly HT_SLOTS
+			bench.ht = open ?
+					   ht_create_open(HT_SLOTS / 8 * 7, sizeof(unsigned int),
+									  hash_string, compare_strings) :
+					   ht_create(HT_SLOTS, hash_string, compare_strings,
+								 ht_free_key_val_function);
+			for (unsigned int i = 0; i < bench.size; i++)
+				ht_put(bench.ht, keys[i], KEY_LENGTH, &i, sizeof(i));
+
+			bench_case cases[] = {
+				{"ht_put", "", HT_BATCH, &bench,
+				 ht_bench_remove_batch, ht_bench_put_batch},
+				{"ht_get_hit", "", LOOKUP_OPS, &bench,
+				 NULL, ht_bench_get_hit},
+				{"ht_get_miss", "", HT_BATCH, &bench,
+				 ht_bench_remove_batch, ht_bench_get_miss},
+				{"ht_remove_entry", "", HT_BATCH, &bench,
+				 ht_bench_put_batch, ht_bench_remove_batch},
+			};
+			for (unsigned int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+			{
+				if (!bench_selected(cases[c].name))
+					continue;
+				snprintf(cases[c].param, sizeof(cases[c].param),
+						 "%s load=%.2f", open ? "open" : "chained", loads[l]);
+				run_case(&cases[c]);
+			}
+
+			ht_free(bench.ht);
+			free(bench.lookups);
+		}
+	}
+
+	free(batch);
+	free(keys);
+}
+
+/**
+ * An open table created with the initial size of a server's name index and
+ * filled like by a transferred range, either reserved at once or growing by
+ * doubling.
+ */
+typedef struct fill_bench
+{
+	hashtable_t *ht;
+	char (*keys)[KEY_LENGTH];
+	bool reserve;
+} fill_bench;
+
+static void fill_bench_reset(void *state)
+{
+	fill_bench *bench = state;
+	if (bench->ht)
+		ht_free(bench->ht);
+	bench->ht = ht_create_open(DATABASE_INDEX_SIZE, sizeof(unsigned int),
+							   hash_string, compare_strings);
+}
+
+static void fill_bench_run(void *state)
+{
+	fill_bench *bench = state;
+	if (bench->reserve)
+		ht_reserve(bench->ht, FILL_KEYS);
+	for (unsigned int i = 0; i < FILL_KEYS; i++)
+		ht_put(bench->ht, bench->keys[i], KEY_LENGTH, &i, sizeof(i));
+}
+
+static void bench_hash_table_fill(void)
+{
+	fill_bench bench = {NULL, create_keys("key-", FILL_KEYS), false};
+
+	for (unsigned int reserve = 0; reserve < 2; reserve++)
+	{
+		bench.reserve = reserve;
+		bench_case fill_case = {"ht_fill", "", FILL_KEYS, &bench,
+								fill_bench_reset, fill_bench_run};
+		if (!bench_selected(fill_case.name))
+			continue;
+		snprintf(fill_case.param, sizeof(fill_case.param), "reserve=%u",
+				 reserve);
+		run_case(&fill_case);
+	}
+
+	if (bench.ht)
+		ht_free(bench.ht);
+	free(bench.keys);
+}
+
+/**
+ * A GET-like access: a hit returns the value, a miss puts the key. With
+ * keys drawn uniformly from a universe of U keys, the hit ratio of an LRU
+ * cache of C entries is C / U; a cyclic scan larger than the cache never
+ * hits.
+ */
+typedef struct cache_bench
+{
+	lru_cache *cache;
+	lru_cache_information *keys;
+	unsigned int *accesses;
+	blob_t *value;
+} cache_bench;
+
+static void cache_bench_access(void *state)
+{
+	cache_bench *bench = state;
+	for (unsigned int i = 0; i < CACHE_OPS; i++)
+	{
+		lru_cache_information *key = &bench->keys[bench->accesses[i]];
+		blob_t *value = lru_cache_get(bench->cache, key);
+		if (value)
+			blob_release(value);
+		else
+			lru_cache_put(bench->cache, key, bench->value, NULL);
+	}
+}
+
+static void bench_lru_cache(void)
+{
+	static const double hit_ratios[] = {0, 0.25, 0.50, 0.75, 1};
+
+	if (!bench_selected("lru_cache_get_put"))
+		return;
+
+	char (*names)[KEY_LENGTH] = create_keys("doc", CACHE_OPS);
+	lru_cache_information *keys =
+	malloc(CACHE_OPS * sizeof(lru_cache_information));
+	DIE(!keys, "malloc failed");
+	for (unsigned int i = 0; i < CACHE_OPS; i++)
+	{
+		keys[i] = create_lru_cache_information(names[i], strlen(names[i]) + 1);
+		keys[i].hash = hash_string(names[i]);
+	}
+
+	for (unsigned int h = 0; h < sizeof(hit_ratios) / sizeof(hit_ratios[0]);
+		 h++)
+	{
+		cache_options options = {CACHE_CAPACITY, 0, CACHE_POLICY_LRU,
+								 hash_string};
+		cache_bench bench;
+		bench.cache = init_lru_cache(&options);
+		bench.keys = keys;
+		bench.value = blob_from_string("lorem ipsum dolor");
+
+		if (hit_ratios[h] == 0)
+		{
+			bench.accesses = malloc(CACHE_OPS * sizeof(unsigned int));
+			DIE(!bench.accesses, "malloc failed");
+			for (unsigned int i = 0; i < CACHE_OPS; i++)
+				bench.accesses[i] = i;
+		}
+		else
+		{
+			unsigned int universe =
+			(unsigned int)(CACHE_CAPACITY / hit_ratios[h]);
+			bench.accesses = create_indices(CACHE_OPS, universe);
+		}
+
+		bench_case access_case = {"lru_cache_get_put", "", CACHE_OPS, &bench,
+								  NULL, cache_bench_access};
+		snprintf(access_case.param, sizeof(access_case.param), "hit=%.2f",
+				 hit_ratios[h]);
+		run_case(&access_case);
+
+		free_lru_cache(&bench.cache);
+		blob_release(bench.value);
+		free(bench.accesses);
+	}
+
+	free(keys);
+	free(names);
+}
+
+static void queue_bench_push_pop(void *state)
+{
+	queue_t *queue = state;
+	for (unsigned int i = 0; i < QUEUE_BATCH; i++)
+		push_queue(queue, &i);
+	for (unsigned int i = 0; i < QUEUE_BATCH; i++)
+	{
+		ll_node_t *node = pop_queue(queue);
+		free(node->data);
+		free(node);
+	}
+}
+
+static void ring_queue_bench_push_pop(void *state)
+{
+	ring_queue_t *queue = state;
+	for (unsigned int i = 0; i < QUEUE_BATCH; i++)
+		push_ring_queue(queue, &i);
+	for (unsigned int i = 0; i < QUEUE_BATCH; i++)
+		pop_ring_queue(queue, NULL);
+}
+
+static void bench_queues(void)
+{
+	queue_t *queue = init_queue(sizeof(unsigned int));
+	bench_case list_case = {"push_pop_queue", "batch=1024", QUEUE_BATCH,
+							queue, NULL, queue_bench_push_pop};
+	if (bench_selected(list_case.name))
+		run_case(&list_case);
+	destroy_queue(&queue);
+
+	ring_queue_t *ring = init_ring_queue(sizeof(unsigned int), QUEUE_BATCH);
+	bench_case ring_case = {"push_pop_ring_queue", "batch=1024", QUEUE_BATCH,
+							ring, NULL, ring_queue_bench_push_pop};
+	if (bench_selected(ring_case.name))
+		run_case(&ring_case);
+	destroy_ring_queue(&ring);
+}
+
+typedef struct ring_bench
+{
+	load_balancer *main;
+	unsigned int *hashes;
+} ring_bench;
+
+static void ring_bench_lookup(void *state)
+{
+	ring_bench *bench = state;
+	server_t *server;
+	unsigned int index;
+	for (unsigned int i = 0; i < LOOKUP_OPS; i++)
+		get_next_replica(bench->main, bench->hashes[i], &server, &index);
+}
+
+static void bench_hash_ring(void)
+{
+	static const unsigned int servers[] = {10, 100, 1000, 10000};
+
+	if (!bench_selected("get_next_replica"))
+		return;
+
+	ring_bench bench;
+	bench.hashes = malloc(LOOKUP_OPS * sizeof(unsigned int));
+	DIE(!bench.hashes, "malloc failed");
+	for (unsigned int i = 0; i < LOOKUP_OPS; i++)
+		bench.hashes[i] = next_random();
+
+	for (unsigned int vnodes = 0; vnodes < 2; vnodes++)
+	{
+		for (unsigned int s = 0; s < sizeof(servers) / sizeof(servers[0]); s++)
+		{
+			cache_options cache = {1, 0, CACHE_POLICY_LRU, NULL};
+			bench.main = init_load_balancer(vnodes);
+			for (unsigned int i = 0; i < servers[s]; i++)
+				loader_add_server(bench.main, i * 7, &cache);
+
+			bench_case lookup_case = {"get_next_replica", "", LOOKUP_OPS,
+									  &bench, NULL, ring_bench_lookup};
+			snprintf(lookup_case.param, sizeof(lookup_case.param),
+					 "servers=%u vnodes=%u", servers[s], vnodes);
+			run_case(&lookup_case);
+
+			free_load_balancer(&bench.main);
+		}
+	}
+
+	free(bench.hashes);
+}
+
+typedef struct database_bench
+{
+	server_t *server;
+	char (*names)[KEY_LENGTH];
+	unsigned int *lookups;
+} database_bench;
+
+static void database_bench_lookup(void *state)
+{
+	database_bench *bench = state;
+	for (unsigned int i = 0; i < LOOKUP_OPS; i++)
+		get_server_data_by_name(bench->server, bench->names[bench->lookups[i]]);
+}
+
+static void bench_server_database(void)
+{
+	static const unsigned int sizes[] = {1000, 10000, 100000, 1000000};
+	const unsigned int max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+
+	if (!bench_selected("get_server_data_by_name"))
+		return;
+
+	database_bench bench;
+	bench.names = create_keys("doc", max_size);
+	blob_t *content = blob_from_string("lorem ipsum dolor");
+
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		cache_options cache = {1, 0, CACHE_POLICY_LRU, NULL};
+		bench.server = init_server(&cache, 0, hash_uint, hash_string, 1);
+		for (unsigned int i = 0; i < sizes[s]; i++)
+		{
+			server_data_t data;
+			data.name = arena_strdup(bench.server->document_bytes,
+									 bench.names[i]);
+			data.content = blob_acquire(content);
+			data.data_hash = hash_string(bench.names[i]);
+			data.associated_replica_index = 0;
+			server_database_add(bench.server, &data);
+		}
+		bench.lookups = create_indices(LOOKUP_OPS, sizes[s]);
+
+		bench_case lookup_case = {"get_server_data_by_name", "", LOOKUP_OPS,
+								  &bench, NULL, database_bench_lookup};
+		snprintf(lookup_case.param, sizeof(lookup_case.param), "documents=%u",
+				 sizes[s]);
+		run_case(&lookup_case);
+
+		free_server(&bench.server);
+		free(bench.lookups);
+	}
+
+	blob_release(content);
+	free(bench.names);
+}
+
+/**
+ * A full task queue of EDITs spread over a number of documents, drained with
+ * or without write coalescing. The responses go to a memory sink.
+ */
+typedef struct drain_bench
+{
+	server_t *server;
+	char (*names)[KEY_LENGTH];
+	unsigned int documents;
+	blob_t *content;
+	output_sink out;
+} drain_bench;
+
+static void drain_bench_fill(void *state)
+{
+	drain_bench *bench = state;
+	output_clear(&bench->out);
+	for (unsigned int i = 0; i < TASK_QUEUE_SIZE; i++)
+	{
+		char *name = bench->names[i % bench->documents];
+		request req;
+		req.type = EDIT_DOCUMENT;
+		req.replica_index = 0;
+		req.key = create_doc_key(name, strlen(name), hash_string);
+		req.doc_content = bench->content;
+		request queued = copy_request(&req);
+		push_task_queue(bench->server, &queued);
+	}
+}
+
+static void drain_bench_execute(void *state)
+{
+	drain_bench *bench = state;
+	execute_server_task_queue(bench->server);
+}
+
+static void bench_task_queue_drain(void)
+{
+	static const unsigned int documents[] = {1000, 100, 10, 1};
+
+	if (!bench_selected("execute_server_task_queue"))
+		return;
+
+	drain_bench bench;
+	bench.names = create_keys("doc", documents[0]);
+	bench.content = blob_from_string("lorem ipsum dolor sit amet");
+	output_memory_init(&bench.out);
+	output_set_current(&bench.out);
+
+	for (unsigned int coalesce = 0; coalesce < 2; coalesce++)
+	{
+		for (unsigned int d = 0; d < sizeof(documents) / sizeof(documents[0]);
+			 d++)
+		{
+			cache_options cache = {64, 0, CACHE_POLICY_LRU, NULL};
+			bench.server = init_server(&cache, 0, hash_uint, hash_string, 1);
+			server_set_write_coalescing(bench.server, coalesce);
+			bench.documents = documents[d];
+
+			bench_case drain_case = {"execute_server_task_queue", "",
+									 TASK_QUEUE_SIZE, &bench,
+									 drain_bench_fill, drain_bench_execute};
+			snprintf(drain_case.param, sizeof(drain_case.param),
+					 "coalesce=%u documents=%u", coalesce, documents[d]);
+			run_case(&drain_case);
+
+			free_server(&bench.server);
+		}
+	}
+
+	output_set_current(NULL);
+	output_memory_free(&bench.out);
+	blob_release(bench.content);
+	free(bench.names);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:r:f:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'w':
+			warmup = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			repetitions = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-w warmup] [-r repetitions] "
+					"[-f name_filter]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	DIE(!repetitions, "at least one repetition is needed");
+
+	printf("benchmark,parameters,ops_per_sample,samples,"
+		   "min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+	bench_hash_tables();
+	bench_hash_table_fill();
+	bench_lru_cache();
+	bench_queues();
+	bench_hash_ring();
+	bench_server_database();
+	bench_task_queue_drain();
+	return 0;
+}
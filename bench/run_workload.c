@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+/**
+ * Runs tema2 on a workload and prints one line of measurements: requests
+ * per second of wall clock time, heap allocations (counted by the preloaded
+ * alloc_count library) and peak resident set size. The responses are
+ * discarded.
+ *
+ *   run_workload [-H] [-r] [-l label] [-p alloc_count.so] <binary> <input>
+ *                [args]
+ *
+ * -H only prints the header of the measurement lines.
+ * -r runs the workload a second time with a STATS request appended and
+ *    prints its routing latency line, so churn can be compared with the
+ *    workloads without topology changes.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../utils.h"
+
+#define STATS_PATH_LENGTH   64
+#define ROUTE_STATS         "[Stats] route_ns "
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * count_requests() - Reads the number of requests from the first line of
+ * the input.
+ */
+static unsigned long count_requests(const char *input)
+{
+	FILE *file = fopen(input, "r");
+	DIE(!file, "fopen failed");
+
+	unsigned long requests = 0;
+	DIE(fscanf(file, "%lu", &requests) != 1, "missing number of requests");
+	fclose(file);
+	return requests;
+}
+
+/**
+ * copy_with_stats() - Copies an input, counting one more request and
+ * appending a STATS request.
+ */
+static void copy_with_stats(const char *input, const char *copy)
+{
+	FILE *in = fopen(input, "r");
+	FILE *out = fopen(copy, "w");
+	DIE(!in || !out, "fopen failed");
+
+	unsigned long requests = 0;
+	DIE(fscanf(in, "%lu", &requests) != 1, "missing number of requests");
+	fprintf(out, "%lu", requests + 1);
+
+	char buffer[BUFSIZ];
+	size_t length = 0, read;
+	while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+	{
+		fwrite(buffer, 1, read, out);
+		length = read;
+	}
+	if (length && buffer[length - 1] != '\n')
+		fputc('\n', out);
+	fputs("STATS\n", out);
+
+	fclose(in);
+	fclose(out);
+}
+
+/**
+ * print_route_latency() - Runs the workload with a STATS request appended
+ * and prints the routing latency histogram it reports.
+ */
+static void print_route_latency(char **command, const char *label)
+{
+	char copy[STATS_PATH_LENGTH];
+	snprintf(copy, sizeof(copy), "/tmp/bench_route.%d", getpid());
+	copy_with_stats(command[1], copy);
+
+	int fds[2];
+	DIE(pipe(fds) < 0, "pipe failed");
+	pid_t child = fork();
+	DIE(child < 0, "fork failed");
+	if (child == 0)
+	{
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		command[1] = copy;
+		execv(command[0], command);
+		DIE(1, "execv failed");
+	}
+
+	close(fds[1]);
+	FILE *output = fdopen(fds[0], "r");
+	DIE(!output, "fdopen failed");
+	char *line = NULL;
+	size_t capacity = 0;
+	while (getline(&line, &capacity, output) > 0)
+	{
+		if (!strncmp(line, ROUTE_STATS, strlen(ROUTE_STATS)))
+			printf("%-12s %s", label, line + strlen("[Stats] "));
+	}
+	free(line);
+	fclose(output);
+
+	int status;
+	DIE(waitpid(child, &status, 0) < 0, "waitpid failed");
+	DIE(!WIFEXITED(status) || WEXITSTATUS(status), "workload failed");
+	unlink(copy);
+}
+
+static void print_header(void)
+{
+	printf("%-12s %10s %10s %12s %14s %12s %12s\n", "workload", "requests",
+		   "seconds", "req_per_s", "allocations", "alloc_bytes",
+		   "peak_rss_kb");
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = NULL;
+	const char *preload = NULL;
+	bool route = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+Hrl:p:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'H':
+			print_header();
+			return 0;
+		case 'r':
+			route = true;
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		case 'p':
+			preload = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-H] [-r] [-l label] [-p alloc_count.so] "
+					"<binary> <input> [args]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind < 2)
+	{
+		fprintf(stderr, "missing binary or input\n");
+		return EXIT_FAILURE;
+	}
+
+	char **command = argv + optind;
+	unsigned long requests = count_requests(command[1]);
+	char stats_path[STATS_PATH_LENGTH];
+	snprintf(stats_path, sizeof(stats_path), "/tmp/bench_alloc.%d", getpid());
+
+	double start = now_seconds();
+	pid_t child = fork();
+	DIE(child < 0, "fork failed");
+	if (child == 0)
+	{
+		int null_fd = open("/dev/null", O_WRONLY);
+		DIE(null_fd < 0, "open failed");
+		dup2(null_fd, STDOUT_FILENO);
+		close(null_fd);
+		if (preload)
+		{
+			setenv("LD_PRELOAD", preload, 1);
+			setenv("BENCH_ALLOC_STATS", stats_path, 1);
+		}
+		execv(command[0], command);
+		DIE(1, "execv failed");
+	}
+
+	int status;
+	struct rusage usage;
+	DIE(wait4(child, &status, 0, &usage) < 0, "wait4 failed");
+	double seconds = now_seconds() - start;
+	DIE(!WIFEXITED(status) || WEXITSTATUS(status), "workload failed");
+
+	// unknown when the run was not preloaded
+	long long allocations = -1, alloc_bytes = -1;
+	FILE *stats = fopen(stats_path, "r");
+	if (stats)
+	{
+		if (fscanf(stats, "%lld %lld", &allocations, &alloc_bytes) != 2)
+			allocations = alloc_bytes = -1;
+		fclose(stats);
+		unlink(stats_path);
+	}
+
+	printf("%-12s %10lu %10.3f %12.0f %14lld %12lld %12ld\n",
+		   label ? label : command[1], requests, seconds, requests / seconds,
+		   allocations, alloc_bytes, usage.ru_maxrss);
+	if (route)
+		print_route_latency(command, label ? label : command[1]);
+	return 0;
+}
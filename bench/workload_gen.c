@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+/**
+ * Generates an input file for tema2: a mix of EDIT and GET requests over a
+ * fixed set of documents, whose popularity is uniform or Zipfian, with
+ * optional ADD_SERVER/REMOVE_SERVER churn. The same options and seed always
+ * produce the same file.
+ *
+ *   workload_gen [-n requests] [-s servers] [-c churn_permille]
+ *                [-r read_percent] [-k documents] [-d uniform|zipf]
+ *                [-z theta] [-m min_content] [-M max_content]
+ *                [-C cache_size] [-p policy] [-v] [-R] [-S seed] [-o output]
+ *
+ * -R ends the workload with a REMOVE_SERVER for every initial server but one,
+ * so each removal redistributes a large share of the documents.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../constants.h"
+#include "../utils.h"
+
+// server IDs stay below the offset of the replica labels
+#define MAX_SERVER_ID   100000
+
+typedef struct workload_options
+{
+	unsigned int requests;
+	unsigned int servers;
+	unsigned int churn_permille;
+	unsigned int read_percent;
+	unsigned int documents;
+	bool zipf;
+	double theta;
+	unsigned int min_content;
+	unsigned int max_content;
+	unsigned int cache_size;
+	const char *policy;
+	bool vnodes;
+	bool remove_at_end;
+	unsigned long long seed;
+	const char *output;
+} workload_options;
+
+static unsigned long long rng_state;
+
+/**
+ * next_random() - splitmix64, so the workloads do not depend on the libc
+ * generator.
+ */
+static unsigned long long next_random(void)
+{
+	unsigned long long z = (rng_state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static unsigned int random_below(unsigned int bound)
+{
+	return (unsigned int)(next_random() % bound);
+}
+
+static double random_unit(void)
+{
+	return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * create_zipf_cdf() - Cumulative probabilities of the documents, the i-th
+ * one being chosen with a probability proportional to 1 / (i + 1)^theta.
+ */
+static double *create_zipf_cdf(unsigned int documents, double theta)
+{
+	double *cdf = malloc(documents * sizeof(double));
+	DIE(!cdf, "malloc failed");
+
+	double sum = 0;
+	for (unsigned int i = 0; i < documents; i++)
+	{
+		sum += 1.0 / pow(i + 1, theta);
+		cdf[i] = sum;
+	}
+	for (unsigned int i = 0; i < documents; i++)
+		cdf[i] /= sum;
+	return cdf;
+}
+
+static unsigned int pick_document(workload_options *options, double *cdf)
+{
+	if (!options->zipf)
+		return random_below(options->documents);
+
+	double u = random_unit();
+	unsigned int low = 0, high = options->documents - 1;
+	while (low < high)
+	{
+		unsigned int middle = low + (high - low) / 2;
+		if (cdf[middle] < u)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/**
+ * pick_server_id() - Picks an ID which is not in use, marking it as used.
+ */
+static unsigned int pick_server_id(unsigned char *used)
+{
+	unsigned int id;
+	do
+		id = random_below(MAX_SERVER_ID);
+	while (used[id]);
+	used[id] = 1;
+	return id;
+}
+
+static void print_add_server(FILE *out, workload_options *options,
+							 unsigned int id)
+{
+	if (options->policy)
+		fprintf(out, "%s %u %u 0 %s\n", ADD_SERVER_REQUEST, id,
+				options->cache_size, options->policy);
+	else
+		fprintf(out, "%s %u %u\n", ADD_SERVER_REQUEST, id,
+				options->cache_size);
+}
+
+static void print_edit(FILE *out, workload_options *options,
+					   unsigned int document)
+{
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+	unsigned int length = options->min_content +
+						  random_below(options->max_content -
+									   options->min_content + 1);
+
+	fprintf(out, "%s \"doc%u\" \"", EDIT_REQUEST, document);
+	for (unsigned int i = 0; i < length; i++)
+		fputc(letters[random_below(sizeof(letters) - 1)], out);
+	fputs("\"\n", out);
+}
+
+static void generate(FILE *out, workload_options *options)
+{
+	double *cdf = options->zipf ?
+				  create_zipf_cdf(options->documents, options->theta) : NULL;
+	unsigned char *used = calloc(MAX_SERVER_ID, 1);
+	unsigned int *active = malloc(2 * options->servers * sizeof(unsigned int));
+	DIE(!used || !active, "malloc failed");
+	unsigned int no_active = 0;
+
+	fprintf(out, "%u%s\n", options->requests,
+			options->vnodes ? " ENABLE_VNODES" : "");
+
+	unsigned int i = 0;
+	for (; i < options->servers && i < options->requests; i++)
+	{
+		active[no_active] = pick_server_id(used);
+		print_add_server(out, options, active[no_active++]);
+	}
+
+	unsigned int removals = options->remove_at_end ? options->servers - 1 : 0;
+	if (removals > options->requests - i)
+		removals = options->requests - i;
+
+	for (; i < options->requests - removals; i++)
+	{
+		if (random_below(1000) < options->churn_permille)
+		{
+			// the number of servers drifts between 1 and twice the initial one
+			bool add = no_active == 1 ||
+					   (no_active < 2 * options->servers &&
+						random_below(2) == 0);
+			if (add)
+			{
+				active[no_active] = pick_server_id(used);
+				print_add_server(out, options, active[no_active++]);
+			}
+			else
+			{
+				unsigned int index = random_below(no_active);
+				fprintf(out, "%s %u\n", REMOVE_SERVER_REQUEST, active[index]);
+				used[active[index]] = 0;
+				active[index] = active[--no_active];
+			}
+		}
+		else if (random_below(100) < options->read_percent)
+		{
+			fprintf(out, "%s \"doc%u\"\n", GET_REQUEST,
+					pick_document(options, cdf));
+		}
+		else
+		{
+			print_edit(out, options, pick_document(options, cdf));
+		}
+	}
+
+	// churn may have left a single server, which reads the rest instead
+	for (; i < options->requests; i++)
+	{
+		if (no_active == 1)
+		{
+			fprintf(out, "%s \"doc%u\"\n", GET_REQUEST,
+					pick_document(options, cdf));
+			continue;
+		}
+
+		unsigned int index = random_below(no_active);
+		fprintf(out, "%s %u\n", REMOVE_SERVER_REQUEST, active[index]);
+		active[index] = active[--no_active];
+	}
+
+	free(active);
+	free(used);
+	free(cdf);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"Usage: %s [-n requests] [-s servers] [-c churn_permille] "
+			"[-r read_percent] [-k documents] [-d uniform|zipf] [-z theta] "
+			"[-m min_content] [-M max_content] [-C cache_size] [-p policy] "
+			"[-v] [-R] [-S seed] [-o output]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	workload_options options = {
+		.requests = 100000,
+		.servers = 8,
+		.churn_permille = 0,
+		.read_percent = 50,
+		.documents = 10000,
+		.zipf = false,
+		.theta = 0.99,
+		.min_content = 16,
+		.max_content = 256,
+		.cache_size = 64,
+		.policy = NULL,
+		.vnodes = false,
+		.remove_at_end = false,
+		.seed = 1,
+		.output = NULL,
+	};
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:c:r:k:d:z:m:M:C:p:vRS:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': options.requests = strtoul(optarg, NULL, 10); break;
+		case 's': options.servers = strtoul(optarg, NULL, 10); break;
+		case 'c': options.churn_permille = strtoul(optarg, NULL, 10); break;
+		case 'r': options.read_percent = strtoul(optarg, NULL, 10); break;
+		case 'k': options.documents = strtoul(optarg, NULL, 10); break;
+		case 'd':
+			if (!strcmp(optarg, "zipf"))
+				options.zipf = true;
+			else if (strcmp(optarg, "uniform"))
+				usage(argv[0]);
+			break;
+		case 'z': options.theta = strtod(optarg, NULL); break;
+		case 'm': options.min_content = strtoul(optarg, NULL, 10); break;
+		case 'M': options.max_content = strtoul(optarg, NULL, 10); break;
+		case 'C': options.cache_size = strtoul(optarg, NULL, 10); break;
+		case 'p': options.policy = optarg; break;
+		case 'v': options.vnodes = true; break;
+		case 'R': options.remove_at_end = true; break;
+		case 'S': options.seed = strtoull(optarg, NULL, 10); break;
+		case 'o': options.output = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (!options.servers || !options.documents || !options.cache_size ||
+		options.min_content > options.max_content ||
+		options.max_content > DOC_CONTENT_LENGTH - 1 ||
+		2 * options.servers > MAX_SERVER_ID / 2)
+		usage(argv[0]);
+
+	FILE *out = options.output ? fopen(options.output, "w") : stdout;
+	DIE(!out, "fopen failed");
+
+	rng_state = options.seed;
+	generate(out, &options);
+
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "blob.h"
+#include "utils.h"
+
+blob_t *blob_create(const char *data, unsigned int size)
+{
+	blob_t *blob = malloc(sizeof(blob_t) + size);
+	DIE(!blob, "malloc failed");
+	blob->refcount = 1;
+	blob->size = size;
+	memcpy(blob->data, data, size);
+	return blob;
+}
+
+blob_t *blob_from_string(const char *string)
+{
+	return blob_create(string, strlen(string) + 1);
+}
+
+blob_t *blob_acquire(blob_t *blob)
+{
+	if (blob)
+		__atomic_add_fetch(&blob->refcount, 1, __ATOMIC_RELAXED);
+	return blob;
+}
+
+void blob_release(blob_t *blob)
+{
+	if (blob && __atomic_sub_fetch(&blob->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+		free(blob);
+}
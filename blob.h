@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef BLOB_H
+#define BLOB_H
+
+/**
+ * Immutable, reference counted byte buffer. A document's content is copied
+ * in a blob once, when its request is read, and from then on the request,
+ * the task queue, the local database, the cache and the response share the
+ * same bytes, each holding its own reference. The references may be dropped
+ * from different threads, so the count is updated atomically.
+ */
+typedef struct blob_t {
+    unsigned int refcount;
+    unsigned int size;
+    char data[];
+} blob_t;
+
+/**
+ * blob_create() - Copies bytes in a new blob with one reference.
+ *
+ * @param size: Number of bytes, the string terminator included.
+ */
+blob_t *blob_create(const char *data, unsigned int size);
+
+/**
+ * blob_from_string() - Copies a string, with its terminator, in a new blob.
+ */
+blob_t *blob_from_string(const char *string);
+
+/**
+ * blob_acquire() - Takes a new reference to a blob.
+ *
+ * @return - The same blob, or NULL if the blob is NULL.
+ */
+blob_t *blob_acquire(blob_t *blob);
+
+/**
+ * blob_release() - Drops a reference, freeing the blob with the last one.
+ * NULL is ignored.
+ */
+void blob_release(blob_t *blob);
+
+#endif /* BLOB_H */
@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cache_policy.h"
+#include "utils.h"
+
+void cache_list_unlink(lru_cache *cache, lru_cache_entry *entry)
+{
+	cache_list *list = &cache->lists[entry->list];
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		list->lru = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		list->mru = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+	list->size--;
+}
+
+void cache_list_link_mru(lru_cache *cache, lru_cache_entry *entry,
+						 unsigned char list_index)
+{
+	cache_list *list = &cache->lists[list_index];
+
+	entry->list = list_index;
+	entry->prev = list->mru;
+	entry->next = NULL;
+
+	if (list->mru)
+		list->mru->next = entry;
+	else
+		list->lru = entry;
+	list->mru = entry;
+	list->size++;
+}
+
+static void cache_list_move_mru(lru_cache *cache, lru_cache_entry *entry,
+								unsigned char list_index)
+{
+	if (entry->list == list_index && entry == cache->lists[list_index].mru)
+		return;
+
+	cache_list_unlink(cache, entry);
+	cache_list_link_mru(cache, entry, list_index);
+}
+
+/**
+ * cache_list_oldest() - Least recently used entry of a list, other than
+ * the kept one.
+ */
+static lru_cache_entry *cache_list_oldest(lru_cache *cache,
+										  unsigned char list_index,
+										  lru_cache_entry *keep)
+{
+	lru_cache_entry *entry = cache->lists[list_index].lru;
+	if (entry && entry == keep)
+		entry = entry->next;
+	return entry;
+}
+
+/*
+ * LRU: a single list, hits move the entry to the most recently used end
+ * and the least recently used entry is evicted.
+ */
+
+static void lru_policy_hit(lru_cache *cache, lru_cache_entry *entry)
+{
+	cache_list_move_mru(cache, entry, 0);
+}
+
+static void lru_policy_insert(lru_cache *cache, lru_cache_entry *entry)
+{
+	cache_list_link_mru(cache, entry, 0);
+}
+
+static lru_cache_entry *lru_policy_victim(lru_cache *cache,
+										  lru_cache_entry *keep)
+{
+	return cache_list_oldest(cache, 0, keep);
+}
+
+static const cache_policy_ops lru_policy = {
+	.name = "LRU",
+	.hit = lru_policy_hit,
+	.insert = lru_policy_insert,
+	.victim = lru_policy_victim,
+};
+
+/*
+ * W-TinyLFU: new entries enter a small LRU window. Under pressure, the
+ * oldest window entry competes with the oldest entry of the main area and
+ * the one which was accessed less often, according to a count-min sketch,
+ * is evicted. The main area is a segmented LRU, where entries hit while on
+ * probation are promoted to the protected segment.
+ */
+
+#define TINYLFU_WINDOW      0
+#define TINYLFU_PROBATION   1
+#define TINYLFU_PROTECTED   2
+
+#define TINYLFU_SKETCH_ROWS         4
+#define TINYLFU_MIN_SKETCH_WIDTH    64
+#define TINYLFU_MAX_FREQUENCY       15
+#define TINYLFU_SAMPLE_FACTOR       10
+
+typedef struct tinylfu_state {
+	unsigned char *sketch;
+	unsigned int sketch_mask;
+	unsigned int additions;
+	unsigned int sample_size;
+	unsigned int window_capacity;
+	unsigned int protected_capacity;
+} tinylfu_state;
+
+static void tinylfu_init(lru_cache *cache)
+{
+	tinylfu_state *state = malloc(sizeof(tinylfu_state));
+	DIE(!state, "malloc failed");
+
+	unsigned int width = TINYLFU_MIN_SKETCH_WIDTH;
+	while (width < 4 * cache->cache_capacity)
+		width <<= 1;
+
+	state->sketch = calloc(TINYLFU_SKETCH_ROWS * width, sizeof(unsigned char));
+	DIE(!state->sketch, "calloc failed");
+	state->sketch_mask = width - 1;
+	state->additions = 0;
+	state->sample_size = TINYLFU_SAMPLE_FACTOR * width;
+
+	// 1% of the entries for the window, 80% of the rest protected
+	state->window_capacity = cache->cache_capacity / 100;
+	if (state->window_capacity == 0)
+		state->window_capacity = 1;
+	unsigned int main_capacity = 0;
+	if (cache->cache_capacity > state->window_capacity)
+		main_capacity = cache->cache_capacity - state->window_capacity;
+	state->protected_capacity = main_capacity * 8 / 10;
+
+	cache->policy_state = state;
+}
+
+static void tinylfu_free(lru_cache *cache)
+{
+	tinylfu_state *state = cache->policy_state;
+	free(state->sketch);
+	free(state);
+}
+
+static unsigned int tinylfu_index(tinylfu_state *state, unsigned int hash,
+								  unsigned int row)
+{
+	hash += row * 0x9e3779b9u;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return row * (state->sketch_mask + 1) + (hash & state->sketch_mask);
+}
+
+static unsigned int tinylfu_frequency(tinylfu_state *state, unsigned int hash)
+{
+	unsigned int frequency = TINYLFU_MAX_FREQUENCY;
+
+	for (unsigned int row = 0; row < TINYLFU_SKETCH_ROWS; row++)
+	{
+		unsigned char counter = state->sketch[tinylfu_index(state, hash, row)];
+		if (counter < frequency)
+			frequency = counter;
+	}
+	return frequency;
+}
+
+static void tinylfu_record(lru_cache *cache, lru_cache_information *key)
+{
+	tinylfu_state *state = cache->policy_state;
+	unsigned int hash = key->hash;
+
+	for (unsigned int row = 0; row < TINYLFU_SKETCH_ROWS; row++)
+	{
+		unsigned char *counter = &state->sketch[tinylfu_index(state, hash, row)];
+		if (*counter < TINYLFU_MAX_FREQUENCY)
+			(*counter)++;
+	}
+
+	// halve every counter periodically, so old popularity fades away
+	if (++state->additions >= state->sample_size)
+	{
+		unsigned int counters = TINYLFU_SKETCH_ROWS * (state->sketch_mask + 1);
+		for (unsigned int i = 0; i < counters; i++)
+			state->sketch[i] >>= 1;
+		state->additions /= 2;
+	}
+}
+
+static void tinylfu_hit(lru_cache *cache, lru_cache_entry *entry)
+{
+	tinylfu_state *state = cache->policy_state;
+
+	if (entry->list != TINYLFU_PROBATION)
+	{
+		cache_list_move_mru(cache, entry, entry->list);
+		return;
+	}
+
+	cache_list_move_mru(cache, entry, TINYLFU_PROTECTED);
+	while (cache->lists[TINYLFU_PROTECTED].size > state->protected_capacity)
+	{
+		lru_cache_entry *demoted = cache->lists[TINYLFU_PROTECTED].lru;
+		cache_list_move_mru(cache, demoted, TINYLFU_PROBATION);
+	}
+}
+
+static void tinylfu_insert(lru_cache *cache, lru_cache_entry *entry)
+{
+	tinylfu_state *state = cache->policy_state;
+
+	cache_list_link_mru(cache, entry, TINYLFU_WINDOW);
+
+	// the cache had room, so the window overflows into the main area
+	while (cache->lists[TINYLFU_WINDOW].size > state->window_capacity)
+	{
+		lru_cache_entry *oldest = cache->lists[TINYLFU_WINDOW].lru;
+		cache_list_move_mru(cache, oldest, TINYLFU_PROBATION);
+	}
+}
+
+static lru_cache_entry *tinylfu_victim(lru_cache *cache, lru_cache_entry *keep)
+{
+	tinylfu_state *state = cache->policy_state;
+	lru_cache_entry *candidate = cache_list_oldest(cache, TINYLFU_WINDOW, keep);
+	lru_cache_entry *main_victim =
+		cache_list_oldest(cache, TINYLFU_PROBATION, keep);
+	if (!main_victim)
+		main_victim = cache_list_oldest(cache, TINYLFU_PROTECTED, keep);
+
+	if (!candidate ||
+		cache->lists[TINYLFU_WINDOW].size < state->window_capacity)
+		return main_victim ? main_victim : candidate;
+
+	if (!main_victim)
+		return candidate;
+
+	// the window is full: its oldest entry is admitted only if popular
+	if (tinylfu_frequency(state, candidate->hash) >
+		tinylfu_frequency(state, main_victim->hash))
+	{
+		cache_list_move_mru(cache, candidate, TINYLFU_PROBATION);
+		return main_victim;
+	}
+	return candidate;
+}
+
+static const cache_policy_ops tinylfu_policy = {
+	.name = "TINYLFU",
+	.init = tinylfu_init,
+	.free = tinylfu_free,
+	.record = tinylfu_record,
+	.hit = tinylfu_hit,
+	.insert = tinylfu_insert,
+	.victim = tinylfu_victim,
+};
+
+/*
+ * ARC: T1 holds the entries seen once and T2 the ones seen at least twice.
+ * Evicted keys are remembered as ghosts in B1 and B2, and a miss on a ghost
+ * moves the target size of T1 towards the list which would have kept it.
+ */
+
+#define ARC_T1 0
+#define ARC_T2 1
+#define ARC_B1 2
+#define ARC_B2 3
+#define ARC_NO_GHOST CACHE_LISTS
+
+typedef struct arc_state {
+	hashtable_t *ghosts;
+	unsigned int target;
+	unsigned char ghost_hit;
+} arc_state;
+
+static void arc_init(lru_cache *cache)
+{
+	arc_state *state = malloc(sizeof(arc_state));
+	DIE(!state, "malloc failed");
+
+	state->ghosts = ht_create(cache->cache_capacity ? 2 * cache->cache_capacity
+													: LRU_CACHE_DEFAULT_BUCKETS,
+							  cache->hash_function,
+							  compare_strings,
+							  ht_free_key_val_function);
+	state->target = 0;
+	state->ghost_hit = ARC_NO_GHOST;
+	cache->policy_state = state;
+}
+
+static void arc_free(lru_cache *cache)
+{
+	arc_state *state = cache->policy_state;
+	// the ghost entries are freed with the entries arena of the cache
+	ht_free(state->ghosts);
+	free(state);
+}
+
+static void arc_drop_ghost(lru_cache *cache, lru_cache_entry *ghost)
+{
+	arc_state *state = cache->policy_state;
+
+	ht_remove_entry_hashed(state->ghosts, ghost->key, ghost->hash);
+	cache_list_unlink(cache, ghost);
+	lru_cache_entry_free(cache, ghost);
+}
+
+static void arc_trim_ghosts(lru_cache *cache)
+{
+	cache_list *lists = cache->lists;
+	unsigned int capacity = cache->cache_capacity;
+
+	while (lists[ARC_B1].size &&
+		   lists[ARC_T1].size + lists[ARC_B1].size > capacity)
+		arc_drop_ghost(cache, lists[ARC_B1].lru);
+
+	while (lists[ARC_B2].size &&
+		   lists[ARC_T1].size + lists[ARC_T2].size +
+		   lists[ARC_B1].size + lists[ARC_B2].size > 2 * capacity)
+		arc_drop_ghost(cache, lists[ARC_B2].lru);
+}
+
+static void arc_hit(lru_cache *cache, lru_cache_entry *entry)
+{
+	cache_list_move_mru(cache, entry, ARC_T2);
+}
+
+static void arc_admit(lru_cache *cache, lru_cache_information *key)
+{
+	arc_state *state = cache->policy_state;
+	unsigned int b1 = cache->lists[ARC_B1].size;
+	unsigned int b2 = cache->lists[ARC_B2].size;
+
+	state->ghost_hit = ARC_NO_GHOST;
+	void *ht_val = ht_get_hashed(state->ghosts, key->data, key->hash);
+	if (ht_val)
+	{
+		lru_cache_entry *ghost = *((lru_cache_entry **)ht_val);
+		state->ghost_hit = ghost->list;
+
+		if (ghost->list == ARC_B1)
+		{
+			unsigned int delta = b2 > b1 ? b2 / b1 : 1;
+			state->target += delta;
+			if (state->target > cache->cache_capacity)
+				state->target = cache->cache_capacity;
+		}
+		else
+		{
+			unsigned int delta = b1 > b2 ? b1 / b2 : 1;
+			state->target = state->target > delta ? state->target - delta : 0;
+		}
+		arc_drop_ghost(cache, ghost);
+	}
+
+	arc_trim_ghosts(cache);
+}
+
+static void arc_insert(lru_cache *cache, lru_cache_entry *entry)
+{
+	arc_state *state = cache->policy_state;
+
+	// a key evicted recently is already known to be reused
+	if (state->ghost_hit == ARC_NO_GHOST)
+		cache_list_link_mru(cache, entry, ARC_T1);
+	else
+		cache_list_link_mru(cache, entry, ARC_T2);
+}
+
+static lru_cache_entry *arc_victim(lru_cache *cache, lru_cache_entry *keep)
+{
+	arc_state *state = cache->policy_state;
+	unsigned int t1 = cache->lists[ARC_T1].size;
+	lru_cache_entry *t1_victim = cache_list_oldest(cache, ARC_T1, keep);
+	lru_cache_entry *t2_victim = cache_list_oldest(cache, ARC_T2, keep);
+
+	if (t1_victim && (!t2_victim || t1 > state->target ||
+					  (state->ghost_hit == ARC_B2 && t1 == state->target)))
+		return t1_victim;
+	return t2_victim;
+}
+
+static void arc_remove(lru_cache *cache, lru_cache_entry *entry, bool evicted)
+{
+	arc_state *state = cache->policy_state;
+	if (!evicted)
+		return;
+
+	lru_cache_entry *ghost = lru_cache_entry_alloc(cache, entry->key_size);
+	ghost->value = NULL;
+	ghost->visited = false;
+	ghost->hash = entry->hash;
+	memcpy(ghost->key, entry->key, entry->key_size);
+	cache_list_link_mru(cache, ghost,
+						entry->list == ARC_T1 ? ARC_B1 : ARC_B2);
+
+	ht_upsert_hashed(state->ghosts,
+					 ghost->key,
+					 ghost->key_size,
+					 ghost->hash,
+					 &ghost,
+					 sizeof(lru_cache_entry *));
+}
+
+static const cache_policy_ops arc_policy = {
+	.name = "ARC",
+	.init = arc_init,
+	.free = arc_free,
+	.hit = arc_hit,
+	.admit = arc_admit,
+	.insert = arc_insert,
+	.victim = arc_victim,
+	.remove = arc_remove,
+};
+
+/*
+ * SIEVE: hits only mark the entry as visited. A hand walks from the oldest
+ * entry towards the newest, clearing the marks, and evicts the first entry
+ * which was not visited since the hand last passed over it.
+ */
+
+typedef struct sieve_state {
+	lru_cache_entry *hand;
+} sieve_state;
+
+static void sieve_init(lru_cache *cache)
+{
+	sieve_state *state = malloc(sizeof(sieve_state));
+	DIE(!state, "malloc failed");
+	state->hand = NULL;
+	cache->policy_state = state;
+}
+
+static void sieve_free(lru_cache *cache)
+{
+	free(cache->policy_state);
+}
+
+static void sieve_hit(lru_cache *cache, lru_cache_entry *entry)
+{
+	(void)cache;
+	entry->visited = true;
+}
+
+static void sieve_insert(lru_cache *cache, lru_cache_entry *entry)
+{
+	entry->visited = false;
+	cache_list_link_mru(cache, entry, 0);
+}
+
+static lru_cache_entry *sieve_victim(lru_cache *cache, lru_cache_entry *keep)
+{
+	sieve_state *state = cache->policy_state;
+	lru_cache_entry *hand = state->hand;
+
+	// two rounds clear every mark, so a victim is found if one exists
+	for (unsigned int step = 0; step <= 2 * cache->lists[0].size; step++)
+	{
+		if (!hand)
+			hand = cache->lists[0].lru;
+		if (!hand)
+			break;
+
+		if (hand != keep)
+		{
+			if (!hand->visited)
+			{
+				state->hand = hand;
+				return hand;
+			}
+			hand->visited = false;
+		}
+		hand = hand->next;
+	}
+
+	state->hand = hand;
+	return NULL;
+}
+
+static void sieve_remove(lru_cache *cache, lru_cache_entry *entry,
+						 bool evicted)
+{
+	sieve_state *state = cache->policy_state;
+	(void)evicted;
+
+	if (state->hand == entry)
+		state->hand = entry->next;
+}
+
+static const cache_policy_ops sieve_policy = {
+	.name = "SIEVE",
+	.init = sieve_init,
+	.free = sieve_free,
+	.hit = sieve_hit,
+	.insert = sieve_insert,
+	.victim = sieve_victim,
+	.remove = sieve_remove,
+};
+
+static const cache_policy_ops *cache_policies[] = {
+	[CACHE_POLICY_LRU] = &lru_policy,
+	[CACHE_POLICY_TINYLFU] = &tinylfu_policy,
+	[CACHE_POLICY_ARC] = &arc_policy,
+	[CACHE_POLICY_SIEVE] = &sieve_policy,
+};
+
+const cache_policy_ops *cache_policy_get(cache_policy_t policy)
+{
+	return cache_policies[policy];
+}
+
+int cache_policy_from_name(const char *name, cache_policy_t *policy)
+{
+	unsigned int policies = sizeof(cache_policies) / sizeof(cache_policies[0]);
+
+	for (unsigned int i = 0; i < policies; i++)
+	{
+		if (strcmp(cache_policies[i]->name, name) == 0)
+		{
+			*policy = (cache_policy_t)i;
+			return 0;
+		}
+	}
+	return -1;
+}
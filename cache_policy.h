@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef CACHE_POLICY_H
+#define CACHE_POLICY_H
+
+#include "lru_cache.h"
+
+/**
+ * Operations through which the cache asks its eviction policy where entries
+ * go and which one leaves next. The cache owns the entries and the byte and
+ * entry accounting; a policy only moves entries between the cache lists and
+ * keeps its own state in cache->policy_state. Optional operations are NULL.
+ */
+struct cache_policy_ops {
+    const char *name;
+
+    void (*init)(lru_cache *cache);
+
+    void (*free)(lru_cache *cache);
+
+    /**
+     * record() - Called on every lookup, before the key is searched.
+     */
+    void (*record)(lru_cache *cache, lru_cache_information *key);
+
+    /**
+     * hit() - Called when a lookup finds the entry or when its value
+     * is replaced.
+     */
+    void (*hit)(lru_cache *cache, lru_cache_entry *entry);
+
+    /**
+     * admit() - Called once before a new key is stored, ahead of the
+     * evictions which make room for it.
+     */
+    void (*admit)(lru_cache *cache, lru_cache_information *key);
+
+    /**
+     * insert() - Links a new entry in one of the cache lists.
+     */
+    void (*insert)(lru_cache *cache, lru_cache_entry *entry);
+
+    /**
+     * victim() - Chooses the next entry to evict.
+     *
+     * @param keep: Entry which must not be chosen, may be NULL.
+     *
+     * @return - The entry to evict, or NULL if there is none.
+     */
+    lru_cache_entry *(*victim)(lru_cache *cache, lru_cache_entry *keep);
+
+    /**
+     * remove() - Called before an entry is unlinked and freed.
+     *
+     * @param evicted: true if the entry was chosen by victim(),
+     *      false if the key was explicitly removed.
+     */
+    void (*remove)(lru_cache *cache, lru_cache_entry *entry, bool evicted);
+};
+
+const cache_policy_ops *cache_policy_get(cache_policy_t policy);
+
+/**
+ * cache_policy_from_name() - Parses a policy name (LRU, TINYLFU, ARC, SIEVE).
+ *
+ * @return - 0 on success, -1 if the name is unknown.
+ */
+int cache_policy_from_name(const char *name, cache_policy_t *policy);
+
+void cache_list_unlink(lru_cache *cache, lru_cache_entry *entry);
+
+void cache_list_link_mru(lru_cache *cache, lru_cache_entry *entry,
+                         unsigned char list);
+
+#endif /* CACHE_POLICY_H */
@@ -15,10 +15,18 @@
 #define GET_REQUEST             "GET"
 #define ADD_SERVER_REQUEST      "ADD_SERVER"
 #define REMOVE_SERVER_REQUEST   "REMOVE_SERVER"
+#define STATS_REQUEST           "STATS"
+#define ADD_SERVER_DELIMITERS   " \r\n"
 
 #define MAX_CHAR_SIZE_INT		11
 
-#define GENERIC_MSG     "[Server %d]-Response: %s\n[Server %d]-Log: %s\n\n"
+/**
+ * A response is printed as RESPONSE_HEADER, its message, LOG_HEADER, its log
+ * and RESPONSE_END, formatted piece by piece in the output buffer.
+ */
+#define RESPONSE_HEADER "[Server %d]-Response: "
+#define LOG_HEADER      "\n[Server %d]-Log: "
+#define RESPONSE_END    "\n\n"
 
 #define MSG_A           "Request- %s %s - has been added to queue"
 #define MSG_B           "Document %s has been overridden"
@@ -27,6 +35,9 @@
 #define LOG_HIT     "Cache HIT for %s"
 #define LOG_MISS    "Cache MISS for %s"
 #define LOG_EVICT   "Cache MISS for %s - cache entry for %s has been evicted"
+#define LOG_EVICT_MULTI     "Cache MISS for %s - cache entries for "
+#define LOG_EVICT_MULTI_END " have been evicted"
+#define EVICTED_KEYS_SEPARATOR ", "
 
 #define LOG_FAULT       "Document %s doesn't exist"
 #define LOG_LAZY_EXEC   "Task queue size is %d"
@@ -37,7 +48,9 @@ typedef enum request_type {
     GET_DOCUMENT,
 
     ADD_SERVER,
-    REMOVE_SERVER
+    REMOVE_SERVER,
+
+    GET_STATS
 } request_type;
 
 #endif  /* CONSTANTS_H */
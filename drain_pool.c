@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "drain_pool.h"
+
+static void deque_init(drain_deque *deque)
+{
+	DIE(pthread_mutex_init(&deque->lock, NULL), "pthread_mutex_init failed");
+	deque->capacity = DRAIN_DEQUE_SIZE;
+	deque->jobs = malloc(deque->capacity * sizeof(server_t *));
+	DIE(!deque->jobs, "malloc failed");
+	deque->top = 0;
+	deque->size = 0;
+}
+
+static void deque_push_bottom(drain_deque *deque, server_t *server)
+{
+	pthread_mutex_lock(&deque->lock);
+	if (deque->size == deque->capacity)
+	{
+		// the jobs are unrolled at the start of the doubled buffer
+		server_t **jobs = malloc(2 * deque->capacity * sizeof(server_t *));
+		DIE(!jobs, "malloc failed");
+		for (unsigned int i = 0; i < deque->size; i++)
+			jobs[i] = deque->jobs[(deque->top + i) % deque->capacity];
+		free(deque->jobs);
+		deque->jobs = jobs;
+		deque->top = 0;
+		deque->capacity *= 2;
+	}
+	deque->jobs[(deque->top + deque->size) % deque->capacity] = server;
+	deque->size++;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+static server_t *deque_pop_bottom(drain_deque *deque)
+{
+	server_t *server = NULL;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->size)
+		server = deque->jobs[(deque->top + --deque->size) % deque->capacity];
+	pthread_mutex_unlock(&deque->lock);
+	return server;
+}
+
+static server_t *deque_steal_top(drain_deque *deque)
+{
+	server_t *server = NULL;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->size)
+	{
+		server = deque->jobs[deque->top];
+		deque->top = (deque->top + 1) % deque->capacity;
+		deque->size--;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return server;
+}
+
+/**
+ * drain_pool_take() - Takes a job of the thread's own deque or, if it is
+ * empty, steals one from the other deques.
+ */
+static server_t *drain_pool_take(drain_pool *pool, unsigned int index)
+{
+	server_t *server = deque_pop_bottom(&pool->deques[index]);
+
+	for (unsigned int i = 1; !server && i < pool->no_threads; i++)
+		server = deque_steal_top(&pool->deques[(index + i) % pool->no_threads]);
+
+	if (server)
+		__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+	return server;
+}
+
+typedef struct drain_thread_args {
+	drain_pool *pool;
+	unsigned int index;
+} drain_thread_args;
+
+static void *drain_pool_run(void *arg)
+{
+	drain_thread_args *args = arg;
+	drain_pool *pool = args->pool;
+	unsigned int index = args->index;
+	free(args);
+
+	for (;;)
+	{
+		server_t *server = drain_pool_take(pool, index);
+		if (!server)
+		{
+			pthread_mutex_lock(&pool->lock);
+			while (!__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) &&
+				   !pool->stop)
+				pthread_cond_wait(&pool->work, &pool->lock);
+			bool stop = pool->stop &&
+						!__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE);
+			pthread_mutex_unlock(&pool->lock);
+			if (stop)
+				break;
+			continue;
+		}
+
+		server_drain_ahead(server);
+
+		pthread_mutex_lock(&pool->lock);
+		__atomic_store_n(&server->draining, 0, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&pool->drained);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+drain_pool *drain_pool_create(unsigned int no_threads)
+{
+	if (!no_threads)
+	{
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		no_threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (no_threads > DRAIN_POOL_MAX_THREADS)
+		no_threads = DRAIN_POOL_MAX_THREADS;
+
+	drain_pool *pool = malloc(sizeof(drain_pool));
+	DIE(!pool, "malloc failed");
+	pool->no_threads = no_threads;
+	pool->next_deque = 0;
+	pool->pending = 0;
+	pool->stop = false;
+	DIE(pthread_mutex_init(&pool->lock, NULL), "pthread_mutex_init failed");
+	DIE(pthread_cond_init(&pool->work, NULL), "pthread_cond_init failed");
+	DIE(pthread_cond_init(&pool->drained, NULL), "pthread_cond_init failed");
+
+	pool->deques = malloc(no_threads * sizeof(drain_deque));
+	pool->threads = malloc(no_threads * sizeof(pthread_t));
+	DIE(!pool->deques || !pool->threads, "malloc failed");
+	for (unsigned int i = 0; i < no_threads; i++)
+		deque_init(&pool->deques[i]);
+
+	for (unsigned int i = 0; i < no_threads; i++)
+	{
+		drain_thread_args *args = malloc(sizeof(drain_thread_args));
+		DIE(!args, "malloc failed");
+		args->pool = pool;
+		args->index = i;
+		DIE(pthread_create(&pool->threads[i], NULL, drain_pool_run, args),
+			"pthread_create failed");
+	}
+	return pool;
+}
+
+void drain_pool_free(drain_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 0; i < pool->no_threads; i++)
+	{
+		pthread_join(pool->threads[i], NULL);
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		free(pool->deques[i].jobs);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->drained);
+	free(pool->deques);
+	free(pool->threads);
+	free(pool);
+}
+
+void drain_pool_submit(drain_pool *pool, server_t *server)
+{
+	if (__atomic_load_n(&server->draining, __ATOMIC_ACQUIRE))
+		return;
+	__atomic_store_n(&server->draining, 1, __ATOMIC_RELAXED);
+
+	// the submitters are not pool threads, so the jobs are spread evenly
+	unsigned int index = __atomic_fetch_add(&pool->next_deque, 1,
+											__ATOMIC_RELAXED) % pool->no_threads;
+	deque_push_bottom(&pool->deques[index], server);
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+
+	pthread_mutex_lock(&pool->lock);
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void drain_pool_wait(drain_pool *pool, server_t *server)
+{
+	if (!__atomic_load_n(&server->draining, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	while (__atomic_load_n(&server->draining, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&pool->drained, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
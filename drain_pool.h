@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef DRAIN_POOL_H
+#define DRAIN_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "server.h"
+
+#define DRAIN_POOL_MAX_THREADS  64
+#define DRAIN_DEQUE_SIZE        16
+
+/**
+ * Jobs of one pool thread. The thread takes the newest job from the bottom,
+ * while idle threads steal the oldest one from the top.
+ */
+typedef struct drain_deque {
+    pthread_mutex_t lock;
+    server_t **jobs;
+    unsigned int top;
+    unsigned int size;
+    unsigned int capacity;
+} drain_deque;
+
+/**
+ * Work-stealing pool which executes the task queues of the servers ahead of
+ * their drains. A job drains one server, so the EDITs of a server are still
+ * applied in order, and a server has at most one job at a time.
+ */
+typedef struct drain_pool {
+    unsigned int no_threads;
+    pthread_t *threads;
+    drain_deque *deques;
+    unsigned int next_deque;
+    // jobs waiting in the deques
+    unsigned int pending;
+    bool stop;
+    // guards the sleeping threads and the servers waited for
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t drained;
+} drain_pool;
+
+/**
+ * drain_pool_create() - Starts a pool.
+ *
+ * @param no_threads: Number of threads, 0 for one per online processor.
+ */
+drain_pool *drain_pool_create(unsigned int no_threads);
+
+/**
+ * drain_pool_free() - Stops a pool whose servers have no jobs left.
+ */
+void drain_pool_free(drain_pool *pool);
+
+/**
+ * drain_pool_submit() - Queues a job draining a server, unless it already
+ * has one. The server must not be used until drain_pool_wait() returns.
+ */
+void drain_pool_submit(drain_pool *pool, server_t *server);
+
+/**
+ * drain_pool_wait() - Waits for the job of a server, if it has one.
+ */
+void drain_pool_wait(drain_pool *pool, server_t *server);
+
+#endif /* DRAIN_POOL_H */
@@ -3,6 +3,7 @@
  */
 
 #include "hash_table.h"
+#include "utils.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -12,147 +13,339 @@ hashtable_t *ht_create(unsigned int hmax, unsigned int (*hash_function)(void *),
 {
 	hashtable_t *ht = malloc(sizeof(hashtable_t));
 
-	ht->buckets = malloc(sizeof(linked_list_t *) * hmax);
+	if (hmax == 0)
+		hmax = 1;
+
+	ht->open = NULL;
+	// buckets are created on their first insertion
+	ht->buckets = calloc(hmax, sizeof(linked_list_t *));
 	ht->hmax = hmax;
+	ht->old_buckets = NULL;
+	ht->old_hmax = 0;
+	ht->rehash_index = 0;
 	ht->hash_function = hash_function;
 	ht->compare_function = compare_function;
 	ht->key_val_free_function = key_val_free_function;
 	ht->size = 0;
-	for (unsigned int i = 0; i < hmax; i++)
-	{
-		ht->buckets[i] = ll_create(sizeof(ht_info));
-	}
 	return ht;
 }
 
-int ht_has_key(hashtable_t *ht, void *key)
+hashtable_t *ht_create_open(unsigned int capacity, unsigned int value_size,
+							unsigned int (*hash_function)(void *),
+							int (*compare_function)(void *, void *))
 {
-	int ind = ht->hash_function(key) % ht->hmax;
+	hashtable_t *ht = malloc(sizeof(hashtable_t));
 
-	if (ht->buckets[ind]->head != NULL)
-	{
-		ll_node_t *node = ht->buckets[ind]->head;
+	ht->open = swiss_create(capacity, value_size,
+							hash_function, compare_function);
+	ht->buckets = NULL;
+	ht->hmax = ht->open->capacity;
+	ht->old_buckets = NULL;
+	ht->old_hmax = 0;
+	ht->rehash_index = 0;
+	ht->hash_function = hash_function;
+	ht->compare_function = compare_function;
+	ht->key_val_free_function = NULL;
+	ht->size = 0;
+	return ht;
+}
 
-		while (node)
-		{
-			ht_info *inform = (ht_info *)node->data;
-			if (ht->compare_function(inform->key, key) == 0)
-			{
-				return 1;
-			}
-			node = node->next;
-		}
-	}
+/**
+ * ht_bucket() - Finds the bucket of a hash. While the table grows, the
+ * buckets of the old array which were not moved yet still hold their keys.
+ *
+ * @param create: If true, an empty bucket is created instead of returning
+ *      NULL.
+ */
+static linked_list_t *ht_bucket(hashtable_t *ht, unsigned int hash,
+								bool create)
+{
+	linked_list_t **bucket;
+
+	if (ht->old_buckets && hash % ht->old_hmax >= ht->rehash_index)
+		bucket = &ht->old_buckets[hash % ht->old_hmax];
+	else
+		bucket = &ht->buckets[hash % ht->hmax];
 
-	return 0;
+	if (!*bucket && create)
+		*bucket = ll_create(sizeof(ht_info));
+	return *bucket;
 }
 
-void *ht_get(hashtable_t *ht, void *key)
+/**
+ * ht_rehash_step() - Moves a few buckets of the old array in the new one,
+ * relinking their nodes without copying the entries or hashing the keys.
+ */
+static void ht_rehash_step(hashtable_t *ht)
 {
-	int ind = ht->hash_function(key) % ht->hmax;
+	if (!ht->old_buckets)
+		return;
 
-	if (ht->buckets[ind]->head != NULL)
+	for (unsigned int step = 0;
+		 step < HT_REHASH_STEP && ht->rehash_index < ht->old_hmax;
+		 step++)
 	{
-		ll_node_t *node = ht->buckets[ind]->head;
+		linked_list_t *old_bucket = ht->old_buckets[ht->rehash_index];
+		// the index moves first, so the keys are looked up in the new array
+		ht->rehash_index++;
+		if (!old_bucket)
+			continue;
 
+		ll_node_t *node = old_bucket->head;
 		while (node)
 		{
+			ll_node_t *next = node->next;
 			ht_info *inform = (ht_info *)node->data;
-			if (ht->compare_function(inform->key, key) == 0)
-			{
-				return inform->value;
-			}
+			linked_list_t *bucket = ht_bucket(ht, inform->hash, true);
 
-			node = node->next;
+			node->next = bucket->head;
+			bucket->head = node;
+			bucket->size++;
+			node = next;
 		}
+		free(old_bucket);
 	}
 
-	return NULL;
+	if (ht->rehash_index == ht->old_hmax)
+	{
+		free(ht->old_buckets);
+		ht->old_buckets = NULL;
+		ht->old_hmax = 0;
+		ht->rehash_index = 0;
+	}
 }
 
-void *ht_remove_entry(hashtable_t *ht, void *key)
+/**
+ * ht_grow() - Starts doubling the number of buckets once the load factor
+ * is exceeded. The entries are moved later, by ht_rehash_step().
+ */
+static void ht_grow(hashtable_t *ht)
 {
-	int ind = ht->hash_function(key) % ht->hmax;
+	if (ht->old_buckets || ht->size <= ht->hmax * HT_MAX_LOAD_FACTOR)
+		return;
 
-	if (ht->buckets[ind]->head != NULL)
+	ht->old_buckets = ht->buckets;
+	ht->old_hmax = ht->hmax;
+	ht->rehash_index = 0;
+	ht->hmax *= 2;
+	ht->buckets = calloc(ht->hmax, sizeof(linked_list_t *));
+}
+
+/**
+ * ht_find_node() - Finds the node of a key in its bucket, comparing the
+ * stored hashes before the keys.
+ *
+ * @param position: RETURNS the position of the node in the bucket.
+ */
+static ll_node_t *ht_find_node(hashtable_t *ht, linked_list_t *bucket,
+							   void *key, unsigned int hash,
+							   unsigned int *position)
+{
+	if (!bucket)
+		return NULL;
+
+	unsigned int i = 0;
+	for (ll_node_t *node = bucket->head; node; node = node->next, i++)
 	{
-		ll_node_t *node = ht->buckets[ind]->head;
-		int i = 0;
-		while (node)
+		ht_info *inform = (ht_info *)node->data;
+		if (inform->hash == hash &&
+			ht->compare_function(inform->key, key) == 0)
 		{
-			ll_node_t *next = node->next;
-			ht_info *inform = (ht_info *)node->data;
-
-			if (ht->compare_function(inform->key, key) == 0)
-			{
-				ll_node_t *rm_node = ll_remove_nth_node(ht->buckets[ind], i);
-				ht->size--;
-				if (ht->key_val_free_function)
-				{
-					ht->key_val_free_function(rm_node);
-					free(rm_node);
-					return NULL;
-				}
-				else
-				{
-					void *data = rm_node->data;
-					free(rm_node);
-					return data;
-				}
-			}
-			i++;
-			node = next;
+			if (position)
+				*position = i;
+			return node;
 		}
 	}
 	return NULL;
 }
 
-int ht_put(hashtable_t *ht, void *key, unsigned int key_size,
-		   void *value, unsigned int value_size)
+int ht_has_key(hashtable_t *ht, void *key)
+{
+	return ht_get(ht, key) != NULL;
+}
+
+void *ht_get(hashtable_t *ht, void *key)
 {
-	int key_exists = 0;
-	int ind = ht->hash_function(key) % ht->hmax;
+	return ht_get_hashed(ht, key, ht->hash_function(key));
+}
+
+void *ht_get_hashed(hashtable_t *ht, void *key, unsigned int hash)
+{
+	if (ht->open)
+		return swiss_get_hashed(ht->open, key, hash);
+
+	ll_node_t *node = ht_find_node(ht, ht_bucket(ht, hash, false),
+								   key, hash, NULL);
+	if (!node)
+		return NULL;
+
+	return ((ht_info *)node->data)->value;
+}
+
+void *ht_remove_entry(hashtable_t *ht, void *key)
+{
+	return ht_remove_entry_hashed(ht, key, ht->hash_function(key));
+}
+
+void *ht_remove_entry_hashed(hashtable_t *ht, void *key, unsigned int hash)
+{
+	if (ht->open)
+	{
+		ht->size -= swiss_remove_hashed(ht->open, key, hash);
+		return NULL;
+	}
+
+	ht_rehash_step(ht);
+	linked_list_t *bucket = ht_bucket(ht, hash, false);
+	unsigned int position;
+	if (!ht_find_node(ht, bucket, key, hash, &position))
+		return NULL;
 
-	ht_info *inform = malloc(sizeof(ht_info));
-	void *cp_key = malloc(key_size);
-	memcpy(cp_key, key, key_size);
+	ll_node_t *rm_node = ll_remove_nth_node(bucket, position);
+	ht->size--;
+	if (ht->key_val_free_function)
+	{
+		ht->key_val_free_function(rm_node);
+		free(rm_node);
+		return NULL;
+	}
+
+	void *data = rm_node->data;
+	free(rm_node);
+	return data;
+}
 
-	void *cp_value = malloc(value_size);
-	memcpy(cp_value, value, value_size);
+void *ht_emplace(hashtable_t *ht, void *key, unsigned int key_size,
+				 unsigned int value_size, bool *inserted)
+{
+	return ht_emplace_hashed(ht, key, key_size, ht->hash_function(key),
+							 value_size, inserted);
+}
+
+void *ht_emplace_hashed(hashtable_t *ht, void *key, unsigned int key_size,
+						unsigned int hash, unsigned int value_size,
+						bool *inserted)
+{
+	if (ht->open)
+	{
+		DIE(value_size > ht->open->value_size, "value too large for table");
+		void *value = swiss_emplace_hashed(ht->open, key, key_size, hash,
+										   inserted);
+		ht->size = ht->open->size;
+		ht->hmax = ht->open->capacity;
+		return value;
+	}
 
-	inform->key = cp_key;
-	inform->value = cp_value;
+	ht_rehash_step(ht);
+	linked_list_t *bucket = ht_bucket(ht, hash, true);
 
-	if (ht_has_key(ht, key))
+	ll_node_t *node = ht_find_node(ht, bucket, key, hash, NULL);
+	if (node)
 	{
-		ht_remove_entry(ht, key);
-		key_exists = 1;
+		ht_info *inform = (ht_info *)node->data;
+		if (inform->val_size != value_size)
+		{
+			inform->value = realloc(inform->value, value_size);
+			DIE(!inform->value, "realloc failed");
+			inform->val_size = value_size;
+		}
+		if (inserted)
+			*inserted = false;
+		return inform->value;
 	}
 
-	ll_add_nth_node(ht->buckets[ind], 0, inform);
+	ht_info inform;
+	inform.key = malloc(key_size);
+	DIE(!inform.key, "malloc failed");
+	memcpy(inform.key, key, key_size);
+	inform.key_size = key_size;
+	inform.hash = hash;
+	inform.value = calloc(1, value_size);
+	DIE(!inform.value, "calloc failed");
+	inform.val_size = value_size;
+
+	ll_add_nth_node(bucket, 0, &inform);
 	ht->size++;
-	free(inform);
-	return key_exists;
+	ht_grow(ht);
+
+	if (inserted)
+		*inserted = true;
+	return inform.value;
 }
 
-void ht_free(hashtable_t *ht)
+int ht_upsert(hashtable_t *ht, void *key, unsigned int key_size,
+			  void *value, unsigned int value_size)
+{
+	return ht_upsert_hashed(ht, key, key_size, ht->hash_function(key),
+							value, value_size);
+}
+
+int ht_upsert_hashed(hashtable_t *ht, void *key, unsigned int key_size,
+					 unsigned int hash, void *value, unsigned int value_size)
+{
+	bool inserted;
+	void *slot = ht_emplace_hashed(ht, key, key_size, hash,
+								   value_size, &inserted);
+	memcpy(slot, value, value_size);
+	return !inserted;
+}
+
+int ht_put(hashtable_t *ht, void *key, unsigned int key_size,
+		   void *value, unsigned int value_size)
+{
+	return ht_upsert(ht, key, key_size, value, value_size);
+}
+
+static void ht_free_buckets(hashtable_t *ht, linked_list_t **buckets,
+							unsigned int hmax)
 {
-	for (unsigned int i = 0; i < ht->hmax; i++)
+	if (!buckets)
+		return;
+
+	for (unsigned int i = 0; i < hmax; i++)
 	{
-		ll_node_t *node = ht->buckets[i]->head;
+		if (!buckets[i])
+			continue;
+
+		ll_node_t *node = buckets[i]->head;
 		while (node)
 		{
 			ll_node_t *next = node->next;
-			ht_info *inform = (ht_info *)node->data;
-			ht_remove_entry(ht, inform->key);
+			if (ht->key_val_free_function)
+				ht->key_val_free_function(node);
+			else
+				free(node->data);
+			free(node);
 			node = next;
 		}
-		free(ht->buckets[i]);
+		free(buckets[i]);
 	}
-	free(ht->buckets);
+	free(buckets);
+}
+
+void ht_free(hashtable_t *ht)
+{
+	if (ht->open)
+	{
+		swiss_free(ht->open);
+		free(ht);
+		return;
+	}
+
+	ht_free_buckets(ht, ht->buckets, ht->hmax);
+	ht_free_buckets(ht, ht->old_buckets, ht->old_hmax);
 	free(ht);
 }
 
+void ht_reserve(hashtable_t *ht, unsigned int keys)
+{
+	if (!ht->open)
+		return;
+
+	swiss_reserve(ht->open, keys);
+	ht->hmax = ht->open->capacity;
+}
+
 unsigned int ht_get_size(hashtable_t *ht)
 {
 	if (ht == NULL)
@@ -178,15 +371,18 @@ void ht_free_key_val_function(void *data)
 	free(info);
 }
 
-void print_ht(hashtable_t *ht)
+static void print_ht_buckets(linked_list_t **buckets, unsigned int hmax)
 {
-	if (ht == NULL)
+	if (!buckets)
 		return;
-	printf("\n--------PRINTING HT - BUCKETS: %u--------\n", ht->hmax);
-	for (unsigned int i = 0; i < ht->hmax; i++)
+
+	for (unsigned int i = 0; i < hmax; i++)
 	{
-		ll_node_t *node = ht->buckets[i]->head;
 		printf("--------BUCKET - %u--------\n", i);
+		if (!buckets[i])
+			continue;
+
+		ll_node_t *node = buckets[i]->head;
 		while (node)
 		{
 			ll_node_t *next = node->next;
@@ -196,3 +392,25 @@ void print_ht(hashtable_t *ht)
 		}
 	}
 }
+
+static void print_ht_open_entry(void *key, void *value, void *arg)
+{
+	(void)value;
+	(void)arg;
+	printf("--------KEY: %s--------\n", (char *)key);
+}
+
+void print_ht(hashtable_t *ht)
+{
+	if (ht == NULL)
+		return;
+	if (ht->open)
+	{
+		printf("\n--------PRINTING HT - SLOTS: %u--------\n", ht->hmax);
+		swiss_for_each(ht->open, print_ht_open_entry, NULL);
+		return;
+	}
+	printf("\n--------PRINTING HT - BUCKETS: %u--------\n", ht->hmax);
+	print_ht_buckets(ht->old_buckets, ht->old_hmax);
+	print_ht_buckets(ht->buckets, ht->hmax);
+}
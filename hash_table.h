@@ -6,21 +6,44 @@
 #define HASH_TABLE_H
 
 #include "linked_list.h"
+#include "swiss_table.h"
+#include <stdbool.h>
 #include <string.h>
 
+/**
+ * A chained table doubles its buckets once it holds more than
+ * HT_MAX_LOAD_FACTOR entries per bucket. The entries are moved to the new
+ * buckets a few old buckets at a time, on every insertion and removal, so
+ * no single operation pays for the whole rehash.
+ */
+#define HT_MAX_LOAD_FACTOR 1
+#ifndef HT_REHASH_STEP
+#define HT_REHASH_STEP 4
+#endif
+
 typedef struct ht_info ht_info;
 struct ht_info {
 	void *key;
 	void *value;
 	unsigned int key_size;
 	unsigned int val_size;
+	unsigned int hash;
 };
 
+/**
+ * A table created by ht_create() chains its entries in buckets, while one
+ * created by ht_create_open() forwards every operation to an open addressing
+ * swiss table, leaving buckets NULL.
+ */
 typedef struct hashtable_t hashtable_t;
 struct hashtable_t {
+	swiss_table_t *open;
 	linked_list_t **buckets;
 	unsigned int size;
 	unsigned int hmax;
+	linked_list_t **old_buckets;
+	unsigned int old_hmax;
+	unsigned int rehash_index;
 	unsigned int (*hash_function)(void*);
 	int (*compare_function)(void*, void*);
 	void (*key_val_free_function)(void*);
@@ -32,16 +55,81 @@ hashtable_t *ht_create(unsigned int hmax, unsigned int (*hash_function)(void*),
 		int (*compare_function)(void*, void*),
 		void (*key_val_free_function)(void*));
 
+/**
+ * ht_create_open() - Creates a table with open addressing and inline values.
+ *
+ * @param capacity: Expected number of keys; the table grows past it.
+ * @param value_size: Size of the values, all of them at most this large.
+ *
+ * @brief The table always owns and frees its key and value copies, so
+ * ht_remove_entry() returns NULL, and ht_get() returns a pointer which is
+ * valid only until the table is modified.
+ */
+hashtable_t *ht_create_open(unsigned int capacity, unsigned int value_size,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*));
+
 int ht_has_key(hashtable_t *ht, void *key);
 
 void *ht_get(hashtable_t *ht, void *key);
 
 void *ht_remove_entry(hashtable_t *ht, void *key);
 
+/**
+ * The *_hashed() variants take the hash of the key, precomputed by the
+ * caller with the table's hash function, instead of hashing the key again.
+ * The tables store the hashes, so they never hash a key twice.
+ */
+void *ht_get_hashed(hashtable_t *ht, void *key, unsigned int hash);
+
+void *ht_remove_entry_hashed(hashtable_t *ht, void *key, unsigned int hash);
 
+
+/**
+ * ht_put() - Copies a key-value pair in the table, overwriting the value in
+ * place if the key exists. Same as ht_upsert().
+ *
+ * @return - 1 if the key existed, 0 otherwise.
+ */
 int ht_put(hashtable_t *ht, void *key, unsigned int key_size,
 	void *value, unsigned int value_size);
 
+/**
+ * ht_emplace() - Hashes the key once and finds its slot once, inserting a
+ * copy of the key with a zeroed value if the key is missing, so the caller
+ * can build the value in place.
+ *
+ * @param value_size: Size of the value; an existing value of another size
+ *      is resized, keeping its common prefix.
+ * @param inserted: Set to true if the key was inserted. May be NULL.
+ *
+ * @return - Pointer to the value of the key. For open tables it is valid
+ *      only until the table is modified.
+ */
+void *ht_emplace(hashtable_t *ht, void *key, unsigned int key_size,
+	unsigned int value_size, bool *inserted);
+
+void *ht_emplace_hashed(hashtable_t *ht, void *key, unsigned int key_size,
+	unsigned int hash, unsigned int value_size, bool *inserted);
+
+/**
+ * ht_upsert() - Overwrites the value of a key in place, or inserts the pair,
+ * copying the key only in that case.
+ *
+ * @return - 1 if the key existed, 0 otherwise.
+ */
+int ht_upsert(hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size);
+
+int ht_upsert_hashed(hashtable_t *ht, void *key, unsigned int key_size,
+	unsigned int hash, void *value, unsigned int value_size);
+
+/**
+ * ht_reserve() - Makes room for a number of keys about to be inserted in an
+ * open table. Chained tables already grow a few buckets at a time.
+ */
+void ht_reserve(hashtable_t *ht, unsigned int keys);
+
 void ht_free(hashtable_t *ht);
 
 unsigned int ht_get_size(hashtable_t *ht);
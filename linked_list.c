@@ -15,22 +15,57 @@ ll_get_size(linked_list_t *list)
 
 linked_list_t *
 ll_create(unsigned int data_size)
+{
+	return ll_create_pooled(data_size, NULL);
+}
+
+linked_list_t *
+ll_create_pooled(unsigned int data_size, slab_pool_t *pool)
 {
 	linked_list_t *linked_list = malloc(sizeof(linked_list_t));
 	linked_list->data_size = data_size;
 	linked_list->head = NULL;
 	linked_list->size = 0;
+	linked_list->pool = pool;
 	return linked_list;
 }
 
+#define LL_NODE_SIZE \
+	((sizeof(ll_node_t) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+
+unsigned int ll_pool_object_size(unsigned int data_size)
+{
+	return LL_NODE_SIZE + data_size;
+}
+
+void ll_node_free(linked_list_t *list, ll_node_t *node)
+{
+	if (list->pool)
+	{
+		slab_free(list->pool, node);
+		return;
+	}
+
+	free(node->data);
+	free(node);
+}
+
 void ll_add_nth_node(linked_list_t *list, unsigned int n, const void *new_data)
 {
 	if (n > ll_get_size(list))
 		n = ll_get_size(list);
 
-	ll_node_t *new_node = malloc(sizeof(ll_node_t));
-
-	new_node->data = malloc(list->data_size);
+	ll_node_t *new_node;
+	if (list->pool)
+	{
+		new_node = slab_alloc(list->pool);
+		new_node->data = (char *)new_node + LL_NODE_SIZE;
+	}
+	else
+	{
+		new_node = malloc(sizeof(ll_node_t));
+		new_node->data = malloc(list->data_size);
+	}
 	memcpy(new_node->data, new_data, list->data_size);
 	new_node->next = NULL;
 
@@ -103,10 +138,7 @@ void ll_free(linked_list_t **pp_list)
 	{
 		ll_node_t *node = ll_remove_nth_node(*pp_list, i);
 		if (node)
-		{
-			free(node->data);
-			free(node);
-		}
+			ll_node_free(*pp_list, node);
 	}
 
 	free(*pp_list);
@@ -259,6 +291,19 @@ dll_remove_nth_node(doubly_linked_list_t *list, unsigned int n)
 	return node;
 }
 
+void dll_remove_node(doubly_linked_list_t *list, dll_node_t *node)
+{
+	node->next->prev = node->prev;
+	node->prev->next = node->next;
+
+	list->size--;
+
+	if (list->size == 0)
+		list->head = NULL;
+	else if (node == list->head)
+		list->head = node->next;
+}
+
 void dll_free(doubly_linked_list_t **pp_list)
 {
 	if (*pp_list == NULL)
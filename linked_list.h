@@ -5,6 +5,8 @@
 #ifndef LINKED_LIST_H
 #define LINKED_LIST_H
 
+#include "slab.h"
+
 typedef struct ll_node_t
 {
     void *data;
@@ -16,6 +18,7 @@ typedef struct linked_list_t
     ll_node_t *head;
     unsigned int data_size;
     unsigned int size;
+    slab_pool_t *pool;
 } linked_list_t;
 
 typedef struct dll_node_t dll_node_t;
@@ -39,6 +42,22 @@ ll_get_size(linked_list_t *list);
 linked_list_t *
 ll_create(unsigned int data_size);
 
+/**
+ * ll_create_pooled() - Creates a list whose nodes are allocated from a pool,
+ * each node with its data right after it.
+ *
+ * @param pool: Pool of objects of ll_pool_object_size(data_size) bytes.
+ */
+linked_list_t *
+ll_create_pooled(unsigned int data_size, slab_pool_t *pool);
+
+unsigned int ll_pool_object_size(unsigned int data_size);
+
+/**
+ * ll_node_free() - Frees a node removed from a list, together with its data.
+ */
+void ll_node_free(linked_list_t *list, ll_node_t *node);
+
 void ll_add_nth_node(linked_list_t *list, unsigned int n, const void *new_data);
 
 ll_node_t *
@@ -62,6 +81,15 @@ void dll_add_nth_node(doubly_linked_list_t *list,
 dll_node_t *
 dll_remove_nth_node(doubly_linked_list_t *list, unsigned int n);
 
+/**
+ * dll_remove_node() - Unlinks a node which is known to be part of the list,
+ * without walking the list.
+ *
+ * @param list: The list containing the node.
+ * @param node: The node to be unlinked. The caller frees it.
+ */
+void dll_remove_node(doubly_linked_list_t *list, dll_node_t *node);
+
 void dll_free(doubly_linked_list_t **pp_list);
 
 dll_node_t *dll_get_next_node(doubly_linked_list_t *list, dll_node_t *node);
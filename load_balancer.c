@@ -4,15 +4,25 @@
 
 #include "load_balancer.h"
 #include "server.h"
+#include "output.h"
 #include <stdlib.h>
 
 load_balancer *init_load_balancer(bool enable_vnodes)
 {
 	load_balancer *lb = malloc(sizeof(load_balancer));
 	lb->enabled_vnodes = enable_vnodes;
+	lb->coalesce_writes = false;
+	lb->targeted_reads = false;
 	lb->hash_function_docs = hash_string;
 	lb->hash_function_servers = hash_uint;
 	lb->servers = dll_create(sizeof(server_t));
+	lb->ring = malloc(sizeof(ring_snapshot_t));
+	DIE(lb->ring == NULL, "malloc failed");
+	lb->ring->size = 0;
+	lb->pipeline = NULL;
+	lb->drain_pool = NULL;
+	lb->online_rebalance = false;
+	lb->migrations = NULL;
 	return lb;
 }
 
@@ -23,6 +33,89 @@ unsigned int get_number_replicas(load_balancer *main)
 	return 1;
 }
 
+static int ring_entry_compare(ring_entry_t *first, ring_entry_t *second)
+{
+	if (first->hash != second->hash)
+		return first->hash < second->hash ? -1 : 1;
+	if (first->server_id != second->server_id)
+		return first->server_id < second->server_id ? -1 : 1;
+	if (first->replica_index != second->replica_index)
+		return first->replica_index < second->replica_index ? -1 : 1;
+	return 0;
+}
+
+static ring_snapshot_t *ring_snapshot_create(unsigned int size)
+{
+	ring_snapshot_t *ring =
+	malloc(sizeof(ring_snapshot_t) + size * sizeof(ring_entry_t));
+	DIE(ring == NULL, "malloc failed");
+	ring->size = size;
+	return ring;
+}
+
+/**
+ * ring_publish() - Swaps in a new snapshot. Only the main thread routes
+ * requests and publishes snapshots; workers and the drain pool receive the
+ * server of a request, never a snapshot, so the old one is freed at once.
+ */
+static void ring_publish(load_balancer *main, ring_snapshot_t *ring)
+{
+	ring_snapshot_t *old = main->ring;
+	__atomic_store_n(&main->ring, ring, __ATOMIC_RELEASE);
+	free(old);
+}
+
+void ring_add_server(load_balancer *main, server_t *server)
+{
+	ring_snapshot_t *old = main->ring;
+	ring_snapshot_t *ring = ring_snapshot_create(old->size + server->no_replicas);
+	memcpy(ring->entries, old->entries, old->size * sizeof(ring_entry_t));
+	ring->size = old->size;
+
+	for (unsigned int replica_idx = 0;
+		 replica_idx < server->no_replicas;
+		 replica_idx++)
+	{
+		ring_entry_t entry;
+		entry.hash = server->server_hash[replica_idx];
+		entry.server_id = server->server_id;
+		entry.replica_index = replica_idx;
+		entry.server = server;
+
+		// binary search of the insert position
+		unsigned int left = 0, right = ring->size;
+		while (left < right)
+		{
+			unsigned int middle = left + (right - left) / 2;
+			if (ring_entry_compare(&ring->entries[middle], &entry) < 0)
+				left = middle + 1;
+			else
+				right = middle;
+		}
+
+		memmove(&ring->entries[left + 1], &ring->entries[left],
+				(ring->size - left) * sizeof(ring_entry_t));
+		ring->entries[left] = entry;
+		ring->size++;
+	}
+
+	ring_publish(main, ring);
+}
+
+void ring_remove_server(load_balancer *main, server_t *server)
+{
+	ring_snapshot_t *old = main->ring;
+	ring_snapshot_t *ring = ring_snapshot_create(old->size);
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < old->size; i++)
+	{
+		if (old->entries[i].server != server)
+			ring->entries[kept++] = old->entries[i];
+	}
+	ring->size = kept;
+	ring_publish(main, ring);
+}
+
 void get_next_replica(load_balancer *main,
 					  unsigned int hash,
 					  server_t **server,
@@ -32,90 +125,256 @@ void get_next_replica(load_balancer *main,
 	 * if the hash is not the "last" on the hash ring, then
 	 * the replica searched has the lowest hash greater than
 	 * the one sent through paramaters, otherwise the replica
-	 * has the minimum hash compared to all replicas.
+	 * has the minimum hash compared to all replicas. Equal
+	 * hashes are ordered by server ID inside the ring index,
+	 * so the lowest server ID wins.
 	*/
-	unsigned int minimum_found = 0;
-	unsigned int minimum_hash = -1;
-	unsigned int minimum_server_id = -1;
-	unsigned int minimum_index = 0;
-	unsigned int global_minimum = -1;
-	unsigned int global_minimum_index = 0;
-	unsigned int global_minimum_server_id = -1;
-	server_t *global_minimum_server = NULL;
-	dll_node_t *current_server_node = main->servers->head;
-	/**
-	 * for each server and for each replica, calculate the overall minimum hash
-	 * and also the lowest hash greater than the one searched.
-	*/
-	while (current_server_node)
+	ring_snapshot_t *ring = __atomic_load_n(&main->ring, __ATOMIC_ACQUIRE);
+	if (ring->size == 0)
 	{
-		server_t *current_server = get_server_load_balancer_node(current_server_node);
-		for (unsigned int old_replica_idx = 0;
-			 old_replica_idx < current_server->no_replicas;
-			 old_replica_idx++)
+		if (index)
+			*index = 0;
+		return;
+	}
+
+	unsigned int left = 0, right = ring->size;
+	while (left < right)
+	{
+		unsigned int middle = left + (right - left) / 2;
+		if (ring->entries[middle].hash <= hash)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+
+	if (left == ring->size)
+		left = 0;
+
+	if (server)
+		*server = ring->entries[left].server;
+	if (index)
+		*index = ring->entries[left].replica_index;
+}
+
+/**
+ * loader_quiesce_server() - Waits for the requests in flight on a server, so
+ * the calling thread can use it until the next request is posted to it.
+ */
+static void loader_quiesce_server(server_t *server)
+{
+	if (server->worker)
+		worker_quiesce(server->worker);
+	server_wait_drain(server);
+}
+
+/**
+ * loader_add_migration() - Queues the documents of a range whose ownership
+ * already moved, to be transferred between requests. The range is ordered
+ * from the label which took it over, like the arc it now belongs to.
+ */
+static void loader_add_migration(load_balancer *main, server_t *source,
+								 server_t *destination, unsigned int label_hash,
+								 treap_t *documents, bool source_removed)
+{
+	migration_t *migration = malloc(sizeof(migration_t));
+	DIE(!migration, "malloc failed");
+	migration->source = source;
+	migration->destination = destination;
+	migration->documents = documents;
+	migration->documents->origin = label_hash;
+	migration->source_removed = source_removed;
+	migration->next = NULL;
+
+	migration_t **link = &main->migrations;
+	while (*link)
+		link = &(*link)->next;
+	*link = migration;
+}
+
+/**
+ * loader_unlink_migration() - Unlinks a migration whose documents have all
+ * moved, freeing its source if it was removed and has no other migrations.
+ */
+static void loader_unlink_migration(load_balancer *main, migration_t **link)
+{
+	migration_t *migration = *link;
+	*link = migration->next;
+	treap_free(&migration->documents);
+
+	bool release = migration->source_removed;
+	for (migration_t *other = main->migrations; other && release;
+		 other = other->next)
+		release = other->source != migration->source;
+	if (release)
+		free_server(&migration->source);
+	free(migration);
+}
+
+/**
+ * loader_finish_migration() - Moves the remaining documents of a migration
+ * and unlinks it.
+ */
+static void loader_finish_migration(load_balancer *main, migration_t **link)
+{
+	migration_t *migration = *link;
+	treap_node_t *node;
+	while ((node = treap_first(migration->documents)))
+		server_database_move(migration->source, migration->documents, node,
+							 migration->destination);
+	loader_unlink_migration(main, link);
+}
+
+/**
+ * loader_split_migrations() - Hands a new label the part of the pending
+ * migrations into the arc it splits, as the documents already stored on the
+ * arc's server are. The split documents stay on their source, so no
+ * document moves at topology time.
+ *
+ * @param server: Server whose arc is split.
+ * @param label: Index of the label of the split arc.
+ * @param added: Server of the new label.
+ * @param new_hash: Hash of the new label.
+ */
+static void loader_split_migrations(load_balancer *main, server_t *server,
+									unsigned int label, server_t *added,
+									unsigned int new_hash)
+{
+	unsigned int label_hash = server->server_hash[label];
+
+	for (migration_t **link = &main->migrations; *link;)
+	{
+		migration_t *migration = *link;
+		if (migration->destination != server ||
+			migration->documents->origin != label_hash)
 		{
-			if (hash < current_server->server_hash[old_replica_idx])
-			{
-				if (!minimum_found ||
-					current_server->server_hash[old_replica_idx] < minimum_hash)
-				{
-					minimum_hash = current_server->server_hash[old_replica_idx];
-					if (server)
-						*server = current_server;
-					minimum_index = old_replica_idx;
-					minimum_found = 1;
-					minimum_server_id = current_server->server_id;
-				}
-				else if (current_server->server_hash[old_replica_idx] == minimum_hash &&
-						 minimum_server_id > current_server->server_id)
-				{
-					minimum_hash = current_server->server_hash[old_replica_idx];
-					if (server)
-						*server = current_server;
-					minimum_index = old_replica_idx;
-					minimum_found = 1;
-					minimum_server_id = current_server->server_id;
-				}
-			}
+			link = &migration->next;
+			continue;
+		}
 
-			if (current_server->server_hash[old_replica_idx] < global_minimum)
-			{
-				global_minimum = current_server->server_hash[old_replica_idx];
-				global_minimum_index = old_replica_idx;
-				global_minimum_server = current_server;
-				global_minimum_server_id = current_server->server_id;
-			}
-			else if (current_server->server_hash[old_replica_idx] == global_minimum &&
-					 current_server->server_id < global_minimum_server_id)
+		treap_t *part = server_database_range(migration->source, new_hash);
+		if (new_hash != label_hash)
+			treap_split_far(migration->documents, label_hash - new_hash, part);
+		else if (added->server_id < server->server_id)
+			treap_merge_far(part, migration->documents);
+
+		if (treap_get_size(part))
+			loader_add_migration(main, migration->source, added, new_hash,
+								 part, migration->source_removed);
+		else
+			treap_free(&part);
+
+		if (!treap_get_size(migration->documents))
+			loader_unlink_migration(main, link);
+		else
+			link = &migration->next;
+	}
+}
+
+/**
+ * loader_align_migrations() - Splits the migrations into a new server so
+ * that each one covers the arc of a single label: a range split off the arc
+ * of another server may also hold the arcs of the new server's other labels.
+ */
+static void loader_align_migrations(load_balancer *main, server_t *server)
+{
+	for (migration_t **link = &main->migrations; *link;)
+	{
+		migration_t *migration = *link;
+		if (migration->destination != server)
+		{
+			link = &migration->next;
+			continue;
+		}
+
+		// the nearest other label before the origin starts the far part
+		unsigned int origin = migration->documents->origin;
+		unsigned int nearest = 0, nearest_distance = 0;
+		for (unsigned int i = 0; i < server->no_replicas; i++)
+		{
+			unsigned int distance = origin - server->server_hash[i];
+			if (distance && (!nearest_distance || distance < nearest_distance))
 			{
-				global_minimum = current_server->server_hash[old_replica_idx];
-				global_minimum_index = old_replica_idx;
-				global_minimum_server = current_server;
-				global_minimum_server_id = current_server->server_id;
+				nearest = server->server_hash[i];
+				nearest_distance = distance;
 			}
 		}
-		current_server_node = dll_get_next_node(main->servers, current_server_node);
+
+		if (nearest_distance)
+		{
+			treap_t *part = server_database_range(migration->source, nearest);
+			treap_split_far(migration->documents, nearest_distance, part);
+			if (treap_get_size(part))
+				loader_add_migration(main, migration->source, server, nearest,
+									 part, migration->source_removed);
+			else
+				treap_free(&part);
+		}
+
+		if (!treap_get_size(migration->documents))
+			loader_unlink_migration(main, link);
+		else
+			link = &migration->next;
 	}
+}
 
-	if (!minimum_found)
+/**
+ * loader_migrate_document() - Moves a document needed by a request of its
+ * new owner, if it is still stored by the previous one.
+ */
+static void loader_migrate_document(load_balancer *main, server_t *server,
+									doc_key *key)
+{
+	for (migration_t **link = &main->migrations; *link;
+		 link = &(*link)->next)
 	{
-		minimum_index = global_minimum_index;
-		if (server)
-			*server = global_minimum_server;
+		migration_t *migration = *link;
+		if (migration->destination != server)
+			continue;
+
+		server_wait_drain(migration->source);
+		treap_node_t **node = ht_get_hashed(migration->source->database_index,
+											key->name, key->hash);
+		if (!node || !treap_contains(migration->documents, *node))
+			continue;
+
+		server_database_move(migration->source, migration->documents, *node,
+							 server);
+		if (!treap_get_size(migration->documents))
+			loader_finish_migration(main, link);
+		return;
 	}
+}
 
-	if (index)
-		*index = minimum_index;
+void loader_rebalance_step(load_balancer *main)
+{
+	migration_t *migration = main->migrations;
+	if (!migration)
+		return;
+
+	treap_node_t *node;
+	for (unsigned int i = 0; i < MIGRATION_BATCH_SIZE &&
+		 (node = treap_first(migration->documents)); i++)
+		server_database_move(migration->source, migration->documents, node,
+							 migration->destination);
+	if (!treap_get_size(migration->documents))
+		loader_finish_migration(main, &main->migrations);
 }
 
-void loader_add_server(load_balancer *main, int server_id, int cache_size)
+void loader_add_server(load_balancer *main, int server_id,
+					   const cache_options *cache)
 {
+	if (main->pipeline)
+		pipeline_begin(main->pipeline);
+	STATS_TIMER(start);
 	server_t *new_server =
-	init_server(cache_size,
+	init_server(cache,
 				server_id,
 				main->hash_function_servers,
 				main->hash_function_docs,
 				get_number_replicas(main));
+	server_set_write_coalescing(new_server, main->coalesce_writes);
+	server_set_targeted_reads(new_server, main->targeted_reads);
+	server_set_drain_pool(new_server, main->drain_pool);
 	/**
 	 * For each replica of the new server, get the next server
 	 * on the hash ring and transfer the documents which correspond
@@ -134,97 +393,73 @@ void loader_add_server(load_balancer *main, int server_id, int cache_size)
 						 &minimum_index);
 		if (next_server)
 		{
+			loader_quiesce_server(next_server);
 			next_server->handler_replica = minimum_index;
 			execute_server_task_queue(next_server);
-			dll_node_t *current_data_node = next_server->local_database->head;
-			unsigned int server_data_index = 0;
-			while (current_data_node)
+			unsigned int new_hash = new_server->server_hash[new_replica_idx];
+			unsigned int next_hash = next_server->server_hash[minimum_index];
+			treap_t *next_arc = next_server->local_database[minimum_index];
+			treap_t *moving = server_database_range(next_server, next_hash);
+			/**
+			 * the documents placed before the new label on the arc of the
+			 * next label are the ones farthest from it, so they are split
+			 * off as a single range and stored on the new server
+			 **/
+			if (new_hash != next_hash)
+				treap_split_far(next_arc, next_hash - new_hash, moving);
+			else if (new_server->server_id < next_server->server_id)
+				treap_merge_far(moving, next_arc);
+
+			loader_split_migrations(main, next_server, minimum_index,
+									new_server, new_hash);
+			if (main->online_rebalance && treap_get_size(moving))
 			{
-				dll_node_t *next_data_node =
-				dll_get_next_node(next_server->local_database, current_data_node);
-				server_data_t *server_data =
-				get_server_data_local_database_node(current_data_node);
-				/**
-				 * store on the new server the documents which are before
-				 * the server on the hash ring
-				 **/
-				if (server_data->associated_replica_index == minimum_index)
-				{
-					if (new_server->server_hash[new_replica_idx] <
-						next_server->server_hash[minimum_index] &&
-						(new_server->server_hash[new_replica_idx] > server_data->data_hash ||
-						 next_server->server_hash[minimum_index] < server_data->data_hash))
-					{
-						dll_node_t *rm_node =
-						dll_remove_nth_node(next_server->local_database, server_data_index);
-						server_data->associated_replica_index = new_replica_idx;
-						dll_add_nth_node(new_server->local_database, 0, server_data);
-
-						lru_cache_information cache_key =
-						create_lru_cache_information(server_data->name,
-													 strlen(server_data->name) + 1);
-						lru_cache_remove(next_server->cache, &cache_key);
-						free(rm_node->data);
-						free(rm_node);
-						server_data_index--;
-					}
-					else if (new_server->server_hash[new_replica_idx] >
-							 next_server->server_hash[minimum_index] &&
-							 new_server->server_hash[new_replica_idx] > server_data->data_hash &&
-							 server_data->data_hash > next_server->server_hash[minimum_index])
-					{
-						dll_node_t *rm_node =
-						dll_remove_nth_node(next_server->local_database, server_data_index);
-						server_data->associated_replica_index = new_replica_idx;
-						dll_add_nth_node(new_server->local_database, 0, server_data);
-
-						lru_cache_information cache_key =
-						create_lru_cache_information(server_data->name,
-													 strlen(server_data->name) + 1);
-						lru_cache_remove(next_server->cache, &cache_key);
-						free(rm_node->data);
-						free(rm_node);
-						server_data_index--;
-					}
-					else if (new_server->server_hash[new_replica_idx] ==
-							 next_server->server_hash[minimum_index] &&
-							 new_server->server_id < next_server->server_id)
-					{
-						dll_node_t *rm_node = dll_remove_nth_node(next_server->local_database,
-																  server_data_index);
-						server_data->associated_replica_index = new_replica_idx;
-						dll_add_nth_node(new_server->local_database, 0, server_data);
-
-						lru_cache_information cache_key =
-						create_lru_cache_information(server_data->name,
-													 strlen(server_data->name) + 1);
-						lru_cache_remove(next_server->cache, &cache_key);
-						free(rm_node->data);
-						free(rm_node);
-						server_data_index--;
-					}
-				}
-				server_data_index++;
-				current_data_node = next_data_node;
+				// only the ownership moves now, the cache forgets the range
+				server_cache_release_range(next_server, moving);
+				loader_add_migration(main, next_server, new_server, new_hash,
+									 moving, false);
+				continue;
 			}
+
+			server_database_transfer(next_server, moving, new_server);
+			treap_free(&moving);
 		}
 	}
 
-	dll_node_t *new_data_node = new_server->local_database->head;
-	while (new_data_node)
-	{
-		server_data_t *server_data =
-		get_server_data_local_database_node(new_data_node);
-		server_data->associated_replica_index =
-		get_associated_label_index_for_data(new_server, server_data);
-		new_data_node = dll_get_next_node(new_server->local_database, new_data_node);
-	}
+	loader_align_migrations(main, new_server);
 	dll_add_nth_node(main->servers, 0, new_server);
+	server_t *added = get_server_load_balancer_node(main->servers->head);
+	ring_add_server(main, added);
+	// the migrations were registered before the server was copied in the list
+	for (migration_t *migration = main->migrations; migration;
+		 migration = migration->next)
+		if (migration->destination == new_server)
+			migration->destination = added;
+	if (main->pipeline)
+		added->worker = worker_start(added, main->pipeline);
 	free(new_server);
+	STATS_RECORD(STATS_ADD_SERVER, start);
+	if (main->pipeline)
+		pipeline_end(main->pipeline);
 }
 
+/**
+ * A range of a removed label, with the label taking it over.
+ */
+typedef struct transfer_range
+{
+	server_t *destination;
+	unsigned int label_index;
+	// distance from the removed label to the one taking the range over
+	unsigned int distance;
+	treap_t *documents;
+} transfer_range;
+
 void loader_remove_server(load_balancer *main, int server_id)
 {
+	if (main->pipeline)
+		pipeline_begin(main->pipeline);
+	STATS_TIMER(start);
 	unsigned int removing_index = 0;
 	dll_node_t *current_server_node = main->servers->head;
 	server_t *rm_server = NULL;
@@ -235,6 +470,7 @@ void loader_remove_server(load_balancer *main, int server_id)
 		if (current_server->server_id == (unsigned int)server_id)
 		{
 			rm_server = current_server;
+			ring_remove_server(main, rm_server);
 			dll_node_t *rm_server_node =
 			dll_remove_nth_node(main->servers, removing_index);
 			free(rm_server_node);
@@ -245,58 +481,228 @@ void loader_remove_server(load_balancer *main, int server_id)
 	}
 
 	if (!rm_server)
+	{
+		if (main->pipeline)
+			pipeline_end(main->pipeline);
 		return;
+	}
+	/**
+	 * the migrations into the removed server are finished only if no server
+	 * is left to take them over, and the ones out of it keep it alive
+	 **/
+	migration_t **link = &main->migrations;
+	while (*link)
+	{
+		if ((*link)->destination == rm_server && !dll_get_size(main->servers))
+			loader_finish_migration(main, link);
+		else
+			link = &(*link)->next;
+	}
+	for (migration_t *migration = main->migrations; migration;
+		 migration = migration->next)
+		migration->source_removed |= migration->source == rm_server;
+	// the worker handles the requests in flight before stopping
+	if (rm_server->worker)
+		worker_stop(rm_server->worker);
+	server_wait_drain(rm_server);
 	rm_server->handler_replica = 0;
 	execute_server_task_queue(rm_server);
 
-	// store the data from the removed server on the next server on the hash ring
-	dll_node_t *current_data_node = rm_server->local_database->head;
-	while (current_data_node && dll_get_size(main->servers) > 0)
+	/**
+	 * the ranges are spliced into the arcs of the labels taking them over,
+	 * closest first when consecutive removed labels share a successor
+	 **/
+	transfer_range ranges[MAX_REPLICAS];
+	unsigned int no_ranges = 0;
+	for (unsigned int rm_replica_idx = 0;
+		 rm_replica_idx < rm_server->no_replicas && dll_get_size(main->servers) > 0;
+		 rm_replica_idx++)
 	{
-		dll_node_t *next_data_node =
-		dll_get_next_node(rm_server->local_database, current_data_node);
-		server_data_t *server_data =
-		get_server_data_local_database_node(current_data_node);
 		server_t *next_server = NULL;
-		unsigned int minimum_index = 0;
-		get_next_replica(main,
-						 rm_server->server_hash[server_data->associated_replica_index],
-						 &next_server,
-						 &minimum_index);
-		server_data->associated_replica_index = minimum_index;
-		dll_add_nth_node(next_server->local_database, 0, server_data);
-		dll_remove_nth_node(rm_server->local_database, 0);
-		free(current_data_node->data);
-		free(current_data_node);
-		current_data_node = next_data_node;
+		unsigned int next_index = 0;
+		unsigned int rm_hash = rm_server->server_hash[rm_replica_idx];
+		treap_t *moving = server_database_range(rm_server, rm_hash);
+		get_next_replica(main, rm_hash, &next_server, &next_index);
+		treap_merge_far(moving, rm_server->local_database[rm_replica_idx]);
+		unsigned int next_hash = next_server->server_hash[next_index];
+
+		if (main->online_rebalance)
+		{
+			// the pending migrations into the label follow its arc
+			for (migration_t *migration = main->migrations; migration;
+				 migration = migration->next)
+			{
+				if (migration->destination == rm_server &&
+					migration->documents->origin == rm_hash)
+				{
+					migration->destination = next_server;
+					migration->documents->origin = next_hash;
+				}
+			}
+
+			if (treap_get_size(moving))
+				loader_add_migration(main, rm_server, next_server, next_hash,
+									 moving, true);
+			else
+				treap_abandon(&moving);
+			continue;
+		}
+
+		loader_quiesce_server(next_server);
+		unsigned int position = no_ranges++;
+		for (; position > 0 &&
+			   ranges[position - 1].distance > next_hash - rm_hash; position--)
+			ranges[position] = ranges[position - 1];
+		ranges[position] = (transfer_range){next_server, next_index,
+											next_hash - rm_hash, moving};
+	}
+
+	/**
+	 * the destination taking over the most documents adopts the pools of
+	 * the removed server, and its name index too when indexing its own
+	 * documents again costs less than indexing the inherited ones
+	 **/
+	server_t *heir = NULL;
+	unsigned int inherited = 0, no_documents = 0;
+	for (unsigned int i = 0; i < no_ranges; i++)
+	{
+		unsigned int documents = 0;
+		for (unsigned int j = 0; j < no_ranges; j++)
+			if (ranges[j].destination == ranges[i].destination)
+				documents += treap_get_size(ranges[j].documents);
+		if (!heir || documents > inherited)
+		{
+			heir = ranges[i].destination;
+			inherited = documents;
+		}
+		no_documents += treap_get_size(ranges[i].documents);
 	}
 
-	free_server(&rm_server);
+	bool adopt_index = heir && get_server_database_size(heir) +
+					   no_documents - inherited < inherited;
+	hashtable_t *adopted_index = adopt_index ? rm_server->database_index : NULL;
+	for (unsigned int i = 0; i < no_ranges; i++)
+		if (ranges[i].destination != heir)
+			server_database_splice(ranges[i].destination, ranges[i].documents,
+								   ranges[i].label_index, adopted_index);
+	if (heir)
+		server_database_adopt(heir, rm_server, adopt_index);
+	for (unsigned int i = 0; i < no_ranges; i++)
+	{
+		if (ranges[i].destination == heir)
+			server_database_splice(heir, ranges[i].documents,
+								   ranges[i].label_index, adopted_index);
+		treap_abandon(&ranges[i].documents);
+	}
+
+	// a removed server with migrations is freed after the last one
+	bool migrating = false;
+	for (migration_t *migration = main->migrations; migration;
+		 migration = migration->next)
+		migrating |= migration->source == rm_server;
+	if (!migrating)
+		free_server(&rm_server);
+	STATS_RECORD(STATS_REMOVE_SERVER, start);
+	if (main->pipeline)
+		pipeline_end(main->pipeline);
 }
 
-response *loader_forward_request(load_balancer *main, request *req)
+bool loader_forward_request(load_balancer *main, request *req, response *res)
 {
-	unsigned int hash = main->hash_function_docs(req->doc_name);
 	server_t *server = NULL;
 	unsigned int index = 0;
-	get_next_replica(main, hash, &server, &index);
+	STATS_TIMER(start);
+	req->key.hash = main->hash_function_docs(req->key.name);
+	get_next_replica(main, req->key.hash, &server, &index);
+	STATS_RECORD(STATS_ROUTE, start);
+	if (main->migrations)
+		loader_migrate_document(main, server, &req->key);
 	req->replica_index = index;
+	server_wait_drain(server);
 	server->handler_replica = req->replica_index;
-	return server_handle_request(server, req);
+	return server_handle_request(server, req, res);
+}
+
+void loader_enable_threads(load_balancer *main)
+{
+	if (main->pipeline)
+		return;
+	main->pipeline = pipeline_create(PIPELINE_SIZE);
+
+	dll_node_t *node = main->servers->head;
+	for (unsigned int i = 0; i < dll_get_size(main->servers); i++)
+	{
+		server_t *server = get_server_load_balancer_node(node);
+		node = node->next;
+		server->worker = worker_start(server, main->pipeline);
+	}
+}
+
+void loader_enable_drain_pool(load_balancer *main)
+{
+	if (main->drain_pool || main->targeted_reads || main->coalesce_writes)
+		return;
+	main->drain_pool = drain_pool_create(0);
+
+	dll_node_t *node = main->servers->head;
+	for (unsigned int i = 0; i < dll_get_size(main->servers); i++)
+	{
+		server_t *server = get_server_load_balancer_node(node);
+		node = node->next;
+		server_set_drain_pool(server, main->drain_pool);
+	}
+}
+
+void loader_enable_online_rebalance(load_balancer *main)
+{
+	if (!main->pipeline)
+		main->online_rebalance = true;
+}
+
+void loader_post_request(load_balancer *main, request *req, bool free_name)
+{
+	server_t *server = NULL;
+	unsigned int index = 0;
+	STATS_TIMER(start);
+	req->key.hash = main->hash_function_docs(req->key.name);
+	get_next_replica(main, req->key.hash, &server, &index);
+	STATS_RECORD(STATS_ROUTE, start);
+	req->replica_index = index;
+	pipeline_post(main->pipeline, server->worker, req, free_name);
+}
+
+void loader_complete_requests(load_balancer *main)
+{
+	if (main->pipeline)
+		pipeline_complete(main->pipeline);
 }
 
 void free_load_balancer(load_balancer **main)
 {
+	loader_complete_requests(*main);
+	while ((*main)->migrations)
+		loader_finish_migration(*main, &(*main)->migrations);
 	unsigned int no_servers = dll_get_size((*main)->servers);
 	for (unsigned int i = 0; i < no_servers; i++)
 	{
 		dll_node_t *server_node = dll_remove_nth_node((*main)->servers, 0);
 		server_t *server = get_server_load_balancer_node(server_node);
 
+		if (server->worker)
+			worker_stop(server->worker);
+		// the nodes of a server may lie in the pools adopted by another one
+		if (i + 1 < no_servers)
+			server_database_adopt(get_server_load_balancer_node(
+								  (*main)->servers->head), server, false);
 		free_server(&server);
 		free(server_node);
 	}
 	free((*main)->servers);
+	free((*main)->ring);
+	if ((*main)->pipeline)
+		pipeline_free((*main)->pipeline);
+	if ((*main)->drain_pool)
+		drain_pool_free((*main)->drain_pool);
 	free(*main);
 
 	*main = NULL;
@@ -307,14 +713,34 @@ server_t *get_server_load_balancer_node(dll_node_t *node)
 	return (server_t *)node->data;
 }
 
-void response_free(response *res)
+void loader_print_stats(load_balancer *main)
 {
-	if (res)
+	loader_complete_requests(main);
+#ifndef DISABLE_STATS
+	output_sink *out = output_stdout();
+	stats_print_global(out);
+
+	dll_node_t *node = main->servers->head;
+	for (unsigned int i = 0; i < dll_get_size(main->servers); i++)
 	{
-		free(res->server_log);
-		free(res->server_response);
-		free(res);
+		server_t *server = get_server_load_balancer_node(node);
+		node = node->next;
+		server_wait_drain(server);
+		// the documents of the ranges it owns already are counted
+		unsigned int documents = get_server_database_size(server);
+		for (migration_t *migration = main->migrations; migration;
+			 migration = migration->next)
+			if (migration->destination == server)
+				documents += treap_get_size(migration->documents);
+		output_printf(out, "[Stats] [Server %u] documents=%u queue=%u",
+					  server->server_id, documents,
+					  get_task_queue_size(server));
+		stats_print_counters(out, server->stats);
+		output_puts(out, "\n");
 	}
+#else
+	(void)main;
+#endif
 }
 
 void print_load_balancer(load_balancer *main)
@@ -7,14 +7,66 @@
 
 #include "server.h"
 #include "linked_list.h"
+#include "worker.h"
+#include "drain_pool.h"
 
 #define MAX_SERVERS             99999
+#define PIPELINE_SIZE           1024
+// documents moved between two requests in online rebalance mode
+#define MIGRATION_BATCH_SIZE    64
+
+/**
+ * One replica label placed on the hash ring. The ring index keeps these
+ * entries sorted by (hash, server ID, replica index), so the first entry
+ * with a given hash is also the one with the lowest server ID.
+ */
+typedef struct ring_entry {
+    unsigned int hash;
+    unsigned int server_id;
+    unsigned int replica_index;
+    server_t *server;
+} ring_entry_t;
+
+/**
+ * Immutable ring index. A topology change builds a new snapshot and swaps it
+ * in with a single atomic store, so routing never waits for it.
+ */
+typedef struct ring_snapshot {
+    unsigned int size;
+    ring_entry_t entries[];
+} ring_snapshot_t;
+
+/**
+ * Range which changed owner in online rebalance mode, while its documents
+ * are still stored by the previous owner. They move in batches between the
+ * requests, or one by one when a request of the new owner needs them. The
+ * documents are ordered from the label which took the range over, so a later
+ * topology change splits or re-targets the range instead of finishing it.
+ */
+typedef struct migration {
+    server_t *source;
+    server_t *destination;
+    treap_t *documents;
+    // the source was removed and is freed after its last migration
+    bool source_removed;
+    struct migration *next;
+} migration_t;
 
 typedef struct load_balancer {
     unsigned int (*hash_function_servers)(void *);
     unsigned int (*hash_function_docs)(void *);
     bool enabled_vnodes;
+    bool coalesce_writes;
+    bool targeted_reads;
     doubly_linked_list_t *servers;
+    ring_snapshot_t *ring;
+    // requests in flight on the server workers, NULL when not threaded
+    request_pipeline *pipeline;
+    // pool executing the task queues ahead of the drains, NULL if none
+    drain_pool *drain_pool;
+    bool online_rebalance;
+    // pending migrations, oldest first
+    migration_t *migrations;
 } load_balancer;
 
 
@@ -27,14 +79,19 @@ void free_load_balancer(load_balancer** main);
  * 
  * @param main: Load balancer which distributes the work.
  * @param server_id: ID of the new server.
- * @param cache_size: Capacity of the new server's cache.
+ * @param cache: Capacity, byte budget (0 if the cache is only bounded by
+ *      its capacity) and eviction policy of the new server's cache.
  * 
  * @brief The load balancer will generate 1 or 3 replica labels and will place
  * them inside the hash ring. The neighbor servers will distribute SOME of the
  * documents to the added server. Before distributing the documents, these
  * servers should execute all the tasks in their queues.
+ * 
+ * In threaded mode, only the requests in flight on these servers are waited
+ * for; the workers of the other servers keep handling theirs.
  */
-void loader_add_server(load_balancer* main, int server_id, int cache_size);
+void loader_add_server(load_balancer* main, int server_id,
+                       const cache_options *cache);
 
 /**
  * loader_remove_server() Removes a server from the system.
@@ -48,6 +105,9 @@ void loader_add_server(load_balancer* main, int server_id, int cache_size);
  * 
  * Additionally, all the tasks stored in the removed server's queue
  * should be executed before moving the documents.
+ * 
+ * In threaded mode, only the requests in flight on the removed server and
+ * on the ones receiving its documents are waited for.
  */
 void loader_remove_server(load_balancer* main, int server_id);
 
@@ -57,8 +117,10 @@ void loader_remove_server(load_balancer* main, int server_id);
  * @param main: Load balancer which distributes the work.
  * @param req: Request to be forwarded (relevant fields from the request are
  *        dynamically allocated, but the caller have to free them).
+ * @param res: Filled with the response received from the server, which
+ *        refers to the document name of the request.
  * 
- * @return response* - Contains the response received from the server
+ * @return bool - true if the server responded to the request.
  * 
  * @brief The load balancer will find the server which should handle the
  * request and will send the request to that server. The request will contain
@@ -66,7 +128,55 @@ void loader_remove_server(load_balancer* main, int server_id);
  * and should be freed either here, either in server_handle_request, after
  * using them.
  */
-response *loader_forward_request(load_balancer* main, request *req);
+bool loader_forward_request(load_balancer* main, request *req,
+                            response *res);
+
+/**
+ * loader_enable_threads() - Gives every server, present or added later, a
+ * worker thread, so the requests of different servers are handled in
+ * parallel. Their responses are still printed in input order.
+ */
+void loader_enable_threads(load_balancer *main);
+
+/**
+ * loader_enable_drain_pool() - Starts a work-stealing pool which executes
+ * the task queues of the servers, present or added later, in the
+ * background. Ignored with targeted reads, whose GETs only execute some of
+ * the queued EDITs, and with write coalescing, which depends on the EDITs
+ * queued after each one at the time of the drain.
+ */
+void loader_enable_drain_pool(load_balancer *main);
+
+/**
+ * loader_enable_online_rebalance() - Makes ADD_SERVER and REMOVE_SERVER
+ * only transfer the ownership of the moving ranges; their documents move
+ * later, by loader_rebalance_step(). Ignored in threaded mode, where the
+ * fallback to the previous owner would have to stop its worker.
+ */
+void loader_enable_online_rebalance(load_balancer *main);
+
+/**
+ * loader_rebalance_step() - Moves at most MIGRATION_BATCH_SIZE documents of
+ * the oldest pending migration. Called between requests.
+ */
+void loader_rebalance_step(load_balancer *main);
+
+/**
+ * loader_post_request() - Routes a request and posts it to the worker of
+ * its server, without waiting for the response.
+ * 
+ * @param main: Load balancer which distributes the work, in threaded mode.
+ * @param req: Request to be posted. The worker releases its content.
+ * @param free_name: Whether the document name is freed once the request
+ *      has been handled.
+ */
+void loader_post_request(load_balancer *main, request *req, bool free_name);
+
+/**
+ * loader_complete_requests() - Waits for all the posted requests and prints
+ * their responses. Does nothing when not threaded.
+ */
+void loader_complete_requests(load_balancer *main);
 
 /**
  * get_server_load_balancer_node() - Gets the server from a load
@@ -77,7 +187,12 @@ response *loader_forward_request(load_balancer* main, request *req);
 */
 server_t *get_server_load_balancer_node(dll_node_t *node);
 
-void response_free(response *res);
+/**
+ * loader_print_stats() - Prints the global metrics, then the counters of
+ * every server, in the output of the responses. Prints nothing when the
+ * instrumentation is compiled out.
+ */
+void loader_print_stats(load_balancer *main);
 
 void print_load_balancer(load_balancer *main);
 
@@ -89,9 +204,28 @@ void print_load_balancer(load_balancer *main);
 */
 unsigned int get_number_replicas(load_balancer *main);
 
+/**
+ * ring_add_server() - Publishes a snapshot of the ring index with all the
+ * replica labels of a server placed inside it.
+ * 
+ * @param main: The load balancer.
+ * @param server: The server, as stored in the load balancer's server list.
+*/
+void ring_add_server(load_balancer *main, server_t *server);
+
+/**
+ * ring_remove_server() - Publishes a snapshot of the ring index without
+ * the replica labels of a server.
+ * 
+ * @param main: The load balancer.
+ * @param server: The server whose labels are removed.
+*/
+void ring_remove_server(load_balancer *main, server_t *server);
+
 /**
  * get_next_replica() - For a specific hash, it finds the next server on the
- * hash ring.
+ * hash ring, using a binary search over the current snapshot of the ring
+ * index.
  * 
  * @param main: The load balancer.
  * @param hash: The hash for which the next server on the hash ring is
@@ -5,168 +5,255 @@
 #include <stdio.h>
 #include <string.h>
 #include "lru_cache.h"
+#include "cache_policy.h"
 #include "utils.h"
 
-lru_cache *init_lru_cache(unsigned int cache_capacity)
+lru_cache *init_lru_cache(const cache_options *options)
 {
 	lru_cache *cache = malloc(sizeof(lru_cache));
-	cache->cache_capacity = cache_capacity;
-	cache->list = dll_create(sizeof(ht_info));
-	cache->ht = ht_create(cache_capacity,
-						  hash_string,
-						  compare_strings,
-						  lru_cache_free_key_and_val_function);
+	cache->cache_capacity = options->capacity;
+	cache->byte_capacity = options->byte_capacity;
+	memset(cache->lists, 0, sizeof(cache->lists));
+	cache->size = 0;
+	cache->bytes = 0;
+	cache->hash_function = options->hash_function;
+	cache->ht = ht_create_open(options->capacity ? options->capacity
+												 : LRU_CACHE_DEFAULT_BUCKETS,
+							   sizeof(lru_cache_entry *),
+							   options->hash_function,
+							   compare_strings);
+	cache->policy = cache_policy_get(options->policy);
+	cache->policy_state = NULL;
+	arena_init(&cache->entries);
+	if (cache->policy->init)
+		cache->policy->init(cache);
 	return cache;
 }
 
-void lru_cache_free_key_and_val_function(void *data)
+lru_cache_entry *lru_cache_entry_alloc(lru_cache *cache, unsigned int key_size)
 {
-	ll_node_t *node = (ll_node_t *)data;
-	ht_info *info = (ht_info *)node->data;
-	dll_node_t *val_node = *((dll_node_t **)info->value);
-	ht_info *inform = (ht_info *)val_node->data;
-	free(inform->key);
-	free(inform->value);
-	free(inform);
-	free(val_node);
-	free(info->value);
-	free(info->key);
-	free(info);
+	lru_cache_entry *entry =
+	arena_alloc(&cache->entries, sizeof(lru_cache_entry) + key_size);
+	entry->key_size = key_size;
+	return entry;
+}
+
+void lru_cache_entry_free(lru_cache *cache, lru_cache_entry *entry)
+{
+	arena_free(&cache->entries, entry,
+			   sizeof(lru_cache_entry) + entry->key_size);
+}
+
+static unsigned int lru_cache_entry_bytes(lru_cache_entry *entry)
+{
+	return entry->key_size + entry->value->size;
+}
+
+static lru_cache_entry *lru_cache_find(lru_cache *cache,
+									   lru_cache_information *key_info)
+{
+	void *ht_val = ht_get_hashed(cache->ht, key_info->data, key_info->hash);
+	if (!ht_val)
+		return NULL;
+	return *((lru_cache_entry **)ht_val);
+}
+
+/**
+ * lru_cache_drop() - Removes an entry from the index and from its list
+ * and frees it. The value survives while other references to it exist.
+ */
+static void lru_cache_drop(lru_cache *cache, lru_cache_entry *entry,
+						   bool evicted)
+{
+	ht_remove_entry_hashed(cache->ht, entry->key, entry->hash);
+	if (cache->policy->remove)
+		cache->policy->remove(cache, entry, evicted);
+	cache_list_unlink(cache, entry);
+	cache->bytes -= lru_cache_entry_bytes(entry);
+	blob_release(entry->value);
+	lru_cache_entry_free(cache, entry);
+	cache->size--;
 }
 
 bool lru_cache_is_full(lru_cache *cache)
 {
-	if (dll_get_size(cache->list) < cache->cache_capacity)
-		return false;
-	else
+	if (cache->size >= cache->cache_capacity)
 		return true;
+	if (cache->byte_capacity && cache->bytes >= cache->byte_capacity)
+		return true;
+	return false;
+}
+
+/**
+ * lru_cache_has_room() - Checks if a new entry of a given size fits in the
+ * cache without evictions.
+ */
+static bool lru_cache_has_room(lru_cache *cache, unsigned int entry_bytes,
+							   bool new_entry)
+{
+	if (new_entry && cache->size >= cache->cache_capacity)
+		return false;
+	if (cache->byte_capacity &&
+		cache->bytes + entry_bytes > cache->byte_capacity)
+		return false;
+	return true;
+}
+
+/**
+ * lru_cache_evict() - Evicts the entries chosen by the policy, other than
+ * the one being written, until the written entry fits.
+ */
+static void lru_cache_evict(lru_cache *cache, lru_cache_entry *keep,
+							unsigned int entry_bytes, bool new_entry,
+							linked_list_t *evicted_keys)
+{
+	while (!lru_cache_has_room(cache, entry_bytes, new_entry))
+	{
+		lru_cache_entry *victim = cache->policy->victim(cache, keep);
+		if (!victim)
+			break;
+
+		if (evicted_keys)
+		{
+			char *evicted_key = malloc(victim->key_size);
+			memcpy(evicted_key, victim->key, victim->key_size);
+			ll_add_nth_node(evicted_keys, ll_get_size(evicted_keys),
+							&evicted_key);
+		}
+		lru_cache_drop(cache, victim, true);
+	}
 }
 
 void free_lru_cache(lru_cache **cache)
 {
+	for (unsigned int i = 0; i < CACHE_LISTS; i++)
+	{
+		// the entries are freed with the arena, only the values are shared
+		for (lru_cache_entry *entry = (*cache)->lists[i].lru; entry;
+			 entry = entry->next)
+			blob_release(entry->value);
+	}
+
+	if ((*cache)->policy->free)
+		(*cache)->policy->free(*cache);
+	arena_release(&(*cache)->entries);
 	ht_free((*cache)->ht);
-	(*cache)->list->size = 0;
-	dll_free(&(*cache)->list);
 	free(*cache);
 	*cache = NULL;
 }
 
-bool lru_cache_put(lru_cache *cache, void *key, void *value,
-				   void **evicted_key)
+bool lru_cache_put(lru_cache *cache, void *key, blob_t *value,
+				   linked_list_t *evicted_keys)
 {
 	lru_cache_information *key_info = (lru_cache_information *)key;
-	lru_cache_information *value_info = (lru_cache_information *)value;
-	void *ht_val = ht_get(cache->ht, key_info->data);
-	int key_exists = 0;
-	if (lru_cache_is_full(cache) && evicted_key)
-	{
-		dll_node_t *lru_node = dll_get_nth_node(cache->list, 0);
-		ht_info *lru_node_info = (ht_info *)lru_node->data;
-		void *lru_key = lru_node_info->key;
-		if (!ht_val)
-		{
-			*evicted_key = malloc(lru_node_info->key_size);
-			memcpy(*evicted_key, lru_key, lru_node_info->key_size);
-			dll_remove_nth_node(cache->list, 0);
-			ht_remove_entry(cache->ht, lru_key);
-		}
-	}
+	lru_cache_entry *entry = lru_cache_find(cache, key_info);
+	unsigned int entry_bytes = key_info->length + value->size;
 
-	if (ht_val)
+	if (entry)
 	{
-		dll_node_t *val_node = *((dll_node_t **)ht_val);
-		if (dll_is_head(cache->list, val_node))
-			cache->list->head = cache->list->head->next;
-		if (val_node->prev != NULL)
-			val_node->prev->next = val_node->next;
-
-		if (val_node->next != NULL)
-			val_node->next->prev = val_node->prev;
-
-		cache->list->size--;
-		if (dll_get_size(cache->list) == 0)
-			cache->list->head = NULL;
-		key_exists = 1;
+		// the key is already cached, only its value and position change
+		cache->bytes -= lru_cache_entry_bytes(entry);
+		lru_cache_evict(cache, entry, entry_bytes, false, evicted_keys);
+		blob_release(entry->value);
+		entry->value = blob_acquire(value);
+		cache->bytes += entry_bytes;
+		cache->policy->hit(cache, entry);
+		return true;
 	}
 
-	ht_info info;
-	info.key = malloc(key_info->length);
-	memcpy(info.key, key_info->data, key_info->length);
-	info.value = malloc(value_info->length);
-	memcpy(info.value, value_info->data, value_info->length);
+	if (cache->policy->admit)
+		cache->policy->admit(cache, key_info);
+	lru_cache_evict(cache, NULL, entry_bytes, true, evicted_keys);
 
-	info.key_size = key_info->length;
-	info.val_size = value_info->length;
-	dll_add_tail(cache->list, &info);
-	dll_node_t *new_cache_queue_node = dll_get_tail(cache->list);
+	entry = lru_cache_entry_alloc(cache, key_info->length);
+	entry->value = blob_acquire(value);
+	entry->visited = false;
+	entry->hash = key_info->hash;
+	memcpy(entry->key, key_info->data, key_info->length);
+	cache->policy->insert(cache, entry);
+	cache->size++;
+	cache->bytes += entry_bytes;
 
-	ht_put(cache->ht,
-		   key_info->data,
-		   key_info->length,
-		   &new_cache_queue_node,
-		   sizeof(dll_node_t *));
+	lru_cache_entry **slot = ht_emplace_hashed(cache->ht,
+											   key_info->data,
+											   key_info->length,
+											   key_info->hash,
+											   sizeof(lru_cache_entry *),
+											   NULL);
+	*slot = entry;
 
-	if (key_exists)
-		return true;
-	else
-		return false;
+	return false;
 }
 
-void *lru_cache_get(lru_cache *cache, void *key, void **evicted_key)
+/**
+ * lru_cache_access() - Records the access to a key for the eviction policy
+ * and finds its entry.
+ */
+static lru_cache_entry *lru_cache_access(lru_cache *cache,
+										 lru_cache_information *key_info)
 {
-	lru_cache_information *key_info = (lru_cache_information *)key;
-	void *data = ht_get(cache->ht, key_info->data);
-	if (data)
-	{
-		dll_node_t *val_node = *((dll_node_t **)data);
-		ht_info *info = (ht_info *)val_node->data;
-		lru_cache_information val_info;
-		val_info.data = info->value;
-		val_info.length = info->val_size;
-		void *ret = malloc(info->val_size);
-		memcpy(ret, info->value, info->val_size);
-		lru_cache_put(cache, key, &val_info, evicted_key);
-
-		return ret;
-	}
+	if (cache->policy->record)
+		cache->policy->record(cache, key_info);
+
+	lru_cache_entry *entry = lru_cache_find(cache, key_info);
+	if (entry)
+		cache->policy->hit(cache, entry);
+	return entry;
+}
 
-	return NULL;
+blob_t *lru_cache_get(lru_cache *cache, void *key)
+{
+	lru_cache_entry *entry = lru_cache_access(cache, key);
+	return entry ? blob_acquire(entry->value) : NULL;
+}
+
+bool lru_cache_touch(lru_cache *cache, void *key)
+{
+	return lru_cache_access(cache, key) != NULL;
 }
 
 void lru_cache_remove(lru_cache *cache, void *key)
 {
 	lru_cache_information *key_info = (lru_cache_information *)key;
-	void *ht_val = ht_get(cache->ht, key_info->data);
-	if (ht_val)
+	lru_cache_entry *entry = lru_cache_find(cache, key_info);
+	if (entry)
+		lru_cache_drop(cache, entry, false);
+}
+
+void lru_cache_remove_if(lru_cache *cache,
+						 bool (*match)(const char *key, unsigned int hash,
+									   void *arg),
+						 void *arg)
+{
+	for (unsigned int i = 0; i < CACHE_LISTS; i++)
 	{
-		dll_node_t *val_node = *((dll_node_t **)ht_val);
-		if (dll_is_head(cache->list, val_node))
-			cache->list->head = cache->list->head->next;
-		if (val_node->prev != NULL)
-			val_node->prev->next = val_node->next;
-
-		if (val_node->next != NULL)
-			val_node->next->prev = val_node->prev;
-
-		cache->list->size--;
-		if (dll_get_size(cache->list) == 0)
-			cache->list->head = NULL;
-		ht_remove_entry(cache->ht, key_info->data);
+		lru_cache_entry *entry = cache->lists[i].lru;
+		while (entry)
+		{
+			lru_cache_entry *next = entry->next;
+			if (entry->value && match(entry->key, entry->hash, arg))
+				lru_cache_drop(cache, entry, false);
+			entry = next;
+		}
 	}
 }
 
 void print_lru_cache(lru_cache *cache)
 {
-	printf("\n--------PRINTING LRU CACHE - CAPACITY: %u--------\n",
-		   cache->cache_capacity);
+	printf("\n--------PRINTING %s CACHE - CAPACITY: %u - BYTES: %u/%u--------\n",
+		   cache->policy->name, cache->cache_capacity,
+		   cache->bytes, cache->byte_capacity);
 	print_ht(cache->ht);
-	dll_node_t *cache_queue_node = cache->list->head;
-	printf("--------PRINTING LRU CACHE QUEUE--------\n");
-	while (cache_queue_node)
+	for (unsigned int i = 0; i < CACHE_LISTS; i++)
 	{
-		ht_info *info = cache_queue_node->data;
-		printf("%s - %s\n", (char *)info->key, (char *)info->value);
-		cache_queue_node = dll_get_next_node(cache->list, cache_queue_node);
+		lru_cache_entry *entry = cache->lists[i].lru;
+		printf("--------PRINTING CACHE LIST %u--------\n", i);
+		while (entry)
+		{
+			printf("%s - %s\n", entry->key,
+				   entry->value ? entry->value->data : "(ghost)");
+			entry = entry->next;
+		}
 	}
 	printf("--------END--------\n");
 }
@@ -177,5 +264,15 @@ lru_cache_information create_lru_cache_information(void *data,
 	lru_cache_information lru_info;
 	lru_info.data = data;
 	lru_info.length = length;
+	lru_info.hash = 0;
+	return lru_info;
+}
+
+lru_cache_information create_lru_cache_key(doc_key *key)
+{
+	lru_cache_information lru_info;
+	lru_info.data = key->name;
+	lru_info.length = key->length + 1;
+	lru_info.hash = key->hash;
 	return lru_info;
 }
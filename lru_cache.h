@@ -8,49 +8,148 @@
 #include <stdbool.h>
 #include "hash_table.h"
 #include "queue.h"
+#include "blob.h"
+#include "slab.h"
+#include "utils.h"
 
+/**
+ * Cache entry, linked directly in one of the recency lists of the cache, from
+ * the least recently used entry to the most recently used one. The key bytes
+ * follow the entry. Entries without a value are ghosts: keys remembered by
+ * the eviction policy after their value was evicted.
+ */
+typedef struct lru_cache_entry lru_cache_entry;
+struct lru_cache_entry {
+    blob_t *value;
+    lru_cache_entry *prev, *next;
+    unsigned char list;
+    bool visited;
+    unsigned int hash;
+    unsigned int key_size;
+    char key[];
+};
+
+#define LRU_CACHE_DEFAULT_BUCKETS 64
+#define CACHE_LISTS 4
+
+typedef struct cache_list {
+    lru_cache_entry *lru;
+    lru_cache_entry *mru;
+    unsigned int size;
+} cache_list;
+
+/**
+ * Eviction policies, chosen per cache. The policy decides in which list an
+ * entry lives, how hits reorder the lists and which entry is evicted next.
+ */
+typedef enum cache_policy_t {
+    CACHE_POLICY_LRU,
+    CACHE_POLICY_TINYLFU,
+    CACHE_POLICY_ARC,
+    CACHE_POLICY_SIEVE
+} cache_policy_t;
+
+typedef struct cache_policy_ops cache_policy_ops;
+
+typedef struct cache_options {
+    unsigned int capacity;
+    unsigned int byte_capacity;
+    cache_policy_t policy;
+    unsigned int (*hash_function)(void*);
+} cache_options;
+
+/**
+ * The cache is bounded by a number of entries and, optionally, by a number
+ * of bytes, where an entry is charged with the size of its key plus the size
+ * of its value. A byte capacity of 0 disables the byte limit.
+ */
 typedef struct lru_cache {
     hashtable_t *ht;
-	doubly_linked_list_t *list;
+    cache_list lists[CACHE_LISTS];
+    unsigned int size;
     unsigned int cache_capacity;
+    unsigned int bytes;
+    unsigned int byte_capacity;
+    unsigned int (*hash_function)(void*);
+    const cache_policy_ops *policy;
+    void *policy_state;
+    arena_t entries;
 } lru_cache;
 
+/**
+ * Keys also carry their hash, computed with the cache's hash function, so
+ * the cache never hashes a key itself.
+ */
 typedef struct lru_cache_information {
 	void *data;
 	unsigned int length;
+	unsigned int hash;
 } lru_cache_information;
 
-lru_cache *init_lru_cache(unsigned int cache_capacity);
+/**
+ * init_lru_cache() - Creates an empty cache.
+ *
+ * @param options: Maximum number of entries, maximum number of key and value
+ *      bytes (0 for no limit), eviction policy and the hash function of
+ *      the keys.
+ */
+lru_cache *init_lru_cache(const cache_options *options);
 
 bool lru_cache_is_full(lru_cache *cache);
 
 void free_lru_cache(lru_cache **cache);
 
+/**
+ * lru_cache_entry_alloc() - Allocates an entry with room for its key from
+ * the arena of the cache, which frees all its entries at once with the
+ * cache. The values are reference counted, so they are allocated apart.
+ */
+lru_cache_entry *lru_cache_entry_alloc(lru_cache *cache, unsigned int key_size);
+
+void lru_cache_entry_free(lru_cache *cache, lru_cache_entry *entry);
+
 /**
  * lru_cache_put() - Adds a new pair in our cache.
  * 
  * @param cache: Cache where the key-value pair will be stored.
  * @param key: Key of the pair.
- * @param value: Value of the pair.
- * @param evicted_key: The function will RETURN via this parameter the
- *      key removed from cache if the cache was full.
+ * @param value: Value of the pair, shared: the cache takes a reference
+ *      instead of copying it.
+ * @param evicted_keys: The function will RETURN via this list copies of the
+ *      keys removed from cache, in eviction order, to make room for the
+ *      value. The list stores char * elements, which the caller frees.
+ *      If NULL, the evicted keys are not reported.
+ * 
+ * @brief Entries chosen by the eviction policy are evicted until the entry
+ * limit and the byte limit leave room for the pair. A value larger than the
+ * whole byte limit evicts everything else and is still stored.
  * 
- * @return - true if the key was added to the cache,
- *      false if the key already existed.
+ * @return - true if the key already existed,
+ *      false if the key was added to the cache.
  */
-bool lru_cache_put(lru_cache *cache, void *key, void *value,
-                   void **evicted_key);
+bool lru_cache_put(lru_cache *cache, void *key, blob_t *value,
+                   linked_list_t *evicted_keys);
 
 /**
- * lru_cache_get() - Retrieves the value associated with a key.
+ * lru_cache_get() - Retrieves the value associated with a key and records
+ * the access for the eviction policy, without copying the value.
  * 
  * @param cache: Cache where the key-value pair is stored.
  * @param key: Key of the pair.
  * 
- * @return - The value associated with the key,
+ * @return - A new reference to the value associated with the key, which
+ *      the caller drops with blob_release(),
  *      or NULL if the key is not found.
  */
-void *lru_cache_get(lru_cache *cache, void *key, void **evicted_key);
+blob_t *lru_cache_get(lru_cache *cache, void *key);
+
+/**
+ * lru_cache_touch() - Records the access to a key like lru_cache_get(),
+ * without taking a reference to its value.
+ * 
+ * @return - true if the key is found.
+ */
+bool lru_cache_touch(lru_cache *cache, void *key);
 
 /**
  * lru_cache_remove() - Removes a key-value pair from the cache.
@@ -60,11 +159,19 @@ void *lru_cache_get(lru_cache *cache, void *key, void **evicted_key);
 */
 void lru_cache_remove(lru_cache *cache, void *key);
 
-void print_lru_cache(lru_cache *cache);
+/**
+ * lru_cache_remove_if() - Removes the key-value pairs whose keys match a
+ * predicate, as lru_cache_remove() would. Ghosts are kept.
+ * 
+ * @param match: Called with the key, its hash and arg, for every pair.
+*/
+void lru_cache_remove_if(lru_cache *cache,
+                         bool (*match)(const char *key, unsigned int hash,
+                                       void *arg),
+                         void *arg);
 
-lru_cache *init_lru_cache(unsigned int cache_capacity);
+void print_lru_cache(lru_cache *cache);
 
-void lru_cache_free_key_and_val_function(void *data);
 
 /**
  * create_lru_cache_information() - Creates a structure containing
@@ -76,4 +183,10 @@ void lru_cache_free_key_and_val_function(void *data);
 lru_cache_information create_lru_cache_information(void *data,
 												   unsigned int length);
 
+/**
+ * create_lru_cache_key() - Creates the key of a document, reusing the hash
+ * of its key descriptor.
+ */
+lru_cache_information create_lru_cache_key(doc_key *key);
+
 #endif /* LRU_CACHE_H */
@@ -3,12 +3,18 @@
  * Copyright (c) 2024, Eduard Marin <marin.eduard.c@gmail.com>
  */
 
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "load_balancer.h"
 #include "lru_cache.h"
+#include "cache_policy.h"
 #include "utils.h"
 #include "constants.h"
 
@@ -33,10 +39,47 @@ void read_quoted_string(char *buffer, int buffer_len, int *start, int *end)
     }
 }
 
+/**
+ * read_server_arguments() - Parses the arguments of an ADD_SERVER or a
+ * REMOVE_SERVER request from a line.
+ */
+void read_server_arguments(char *buffer, request_type req_type,
+                           int *maybe_server_id, int *maybe_cache_size,
+                           cache_options *maybe_cache)
+{
+    if (req_type == ADD_SERVER)
+    {
+        *maybe_server_id = atoi(buffer + strlen(ADD_SERVER_REQUEST) + 1);
+        char *cache_size_arg = strchr(
+            buffer + strlen(ADD_SERVER_REQUEST) + 1, ' ');
+        *maybe_cache_size = atoi(cache_size_arg);
+
+        // the byte budget and the eviction policy of the cache are optional
+        maybe_cache->byte_capacity = 0;
+        maybe_cache->policy = CACHE_POLICY_LRU;
+        strtok(cache_size_arg, ADD_SERVER_DELIMITERS);
+        for (char *arg = strtok(NULL, ADD_SERVER_DELIMITERS); arg;
+             arg = strtok(NULL, ADD_SERVER_DELIMITERS))
+        {
+            if (isdigit((unsigned char)arg[0]))
+                maybe_cache->byte_capacity = strtoul(arg, NULL, 10);
+            else
+                DIE(cache_policy_from_name(arg, &maybe_cache->policy) < 0,
+                    "unknown cache policy");
+        }
+    }
+    else if (req_type == REMOVE_SERVER)
+    {
+        *maybe_server_id = atoi(buffer + strlen(REMOVE_SERVER_REQUEST) + 1);
+    }
+}
+
 request_type read_request_arguments(FILE *input_file, char *buffer,
                                     int *maybe_server_id, int *maybe_cache_size,
+                                    cache_options *maybe_cache,
                                     char **maybe_doc_name,
-                                    char **maybe_doc_content)
+                                    char *content_buffer,
+                                    blob_t **maybe_doc_content)
 {
     request_type req_type;
     int word_start = -1;
@@ -47,17 +90,12 @@ request_type read_request_arguments(FILE *input_file, char *buffer,
 
     req_type = get_request_type(buffer);
 
-    if (req_type == ADD_SERVER)
+    if (req_type == ADD_SERVER || req_type == REMOVE_SERVER)
     {
-        *maybe_server_id = atoi(buffer + strlen(ADD_SERVER_REQUEST) + 1);
-        *maybe_cache_size = atoi(strchr(
-            buffer + strlen(ADD_SERVER_REQUEST) + 1, ' '));
-    }
-    else if (req_type == REMOVE_SERVER)
-    {
-        *maybe_server_id = atoi(buffer + strlen(REMOVE_SERVER_REQUEST) + 1);
+        read_server_arguments(buffer, req_type, maybe_server_id,
+                              maybe_cache_size, maybe_cache);
     }
-    else
+    else if (req_type != GET_STATS)
     {
         *maybe_doc_name = calloc(1, DOC_NAME_LENGTH + 1);
         DIE(*maybe_doc_name == NULL, "calloc failed");
@@ -70,9 +108,7 @@ request_type read_request_arguments(FILE *input_file, char *buffer,
         if (req_type == EDIT_DOCUMENT)
         {
             char *tmp_buffer = buffer + word_end + 1;
-
-            *maybe_doc_content = calloc(1, DOC_CONTENT_LENGTH + 1);
-            DIE(*maybe_doc_content == NULL, "calloc failed");
+            size_t content_length;
 
             /* Read the content, which might be a multiline quoted string */
             word_start = -1;
@@ -80,10 +116,10 @@ request_type read_request_arguments(FILE *input_file, char *buffer,
                                &word_start, &word_end);
 
             if (word_end == -1)
-                strcpy(*maybe_doc_content, tmp_buffer + word_start + 1);
+                content_length = strlen(tmp_buffer + word_start + 1);
             else
-                strncpy(*maybe_doc_content, tmp_buffer + word_start + 1,
-                        word_end - word_start - 1);
+                content_length = word_end - word_start - 1;
+            memcpy(content_buffer, tmp_buffer + word_start + 1, content_length);
 
             while (word_end == -1)
             {
@@ -92,9 +128,17 @@ request_type read_request_arguments(FILE *input_file, char *buffer,
 
                 read_quoted_string(buffer, DOC_CONTENT_LENGTH,
                                    &word_start, &word_end);
-                memcpy(*maybe_doc_content + strlen(*maybe_doc_content), buffer,
-                       word_end == -1 ? strlen(buffer) : (unsigned)word_end);
+                size_t line_length =
+                    word_end == -1 ? strlen(buffer) : (unsigned)word_end;
+                memcpy(content_buffer + content_length, buffer, line_length);
+                content_length += line_length;
             }
+
+            /* The content is copied once more, in the blob shared by all
+             * the layers which keep it */
+            content_buffer[content_length] = '\0';
+            *maybe_doc_content = blob_create(content_buffer,
+                                             content_length + 1);
         }
         else
         {
@@ -105,35 +149,229 @@ request_type read_request_arguments(FILE *input_file, char *buffer,
     return req_type;
 }
 
-void apply_requests(FILE *input_file, char *buffer,
-                    int requests_num, bool enable_vnodes)
+/**
+ * Input file mapped in memory by the --mmap mode. The mapping is private and
+ * writable, so the parser terminates names and contents in place, over
+ * their closing quotes, and hands them out without copying them.
+ */
+typedef struct mapped_input
 {
-    char *doc_name, *doc_content;
-    int server_id, cache_size;
+    char *data;
+    size_t size;
+    size_t position;
+} mapped_input;
+
+void map_input_file(const char *path, mapped_input *input)
+{
+    struct stat input_stat;
+    int fd = open(path, O_RDONLY);
+    DIE(fd < 0, "missing input file");
+    DIE(fstat(fd, &input_stat) < 0, "fstat failed");
+
+    input->size = input_stat.st_size;
+    input->position = 0;
+    input->data = NULL;
+    if (input->size)
+    {
+        input->data = mmap(NULL, input->size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, fd, 0);
+        DIE(input->data == MAP_FAILED, "mmap failed");
+        madvise(input->data, input->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+
+void unmap_input_file(mapped_input *input)
+{
+    if (input->data)
+        munmap(input->data, input->size);
+}
+
+/**
+ * next_mapped_line() - Returns the next line, without its newline, and
+ * moves past it.
+ */
+char *next_mapped_line(mapped_input *input, size_t *length)
+{
+    DIE(input->position >= input->size, "insufficient requests");
+
+    char *line = input->data + input->position;
+    size_t left = input->size - input->position;
+    char *newline = memchr(line, '\n', left);
+
+    *length = newline ? (size_t)(newline - line) : left;
+    input->position += *length + (newline != NULL);
+    return line;
+}
+
+/**
+ * copy_mapped_line() - Copies at most max_length bytes of a line in a
+ * buffer, as a string. The mapping has no terminator after its last line,
+ * so the few lines parsed as strings are copied.
+ */
+void copy_mapped_line(char *buffer, const char *line, size_t length,
+                      size_t max_length)
+{
+    if (length > max_length)
+        length = max_length;
+    memcpy(buffer, line, length);
+    buffer[length] = '\0';
+}
+
+/**
+ * read_mapped_request_arguments() - Same as read_request_arguments(), in a
+ * single pass over the mapped input. The name points inside the mapping,
+ * and a multiline content is the contiguous range between its quotes, which
+ * is copied only in its blob.
+ */
+request_type read_mapped_request_arguments(mapped_input *input, char *buffer,
+                                           int *maybe_server_id,
+                                           int *maybe_cache_size,
+                                           cache_options *maybe_cache,
+                                           char **maybe_doc_name,
+                                           blob_t **maybe_doc_content)
+{
+    size_t length;
+    char *line = next_mapped_line(input, &length);
+    char *line_end = line + length;
 
-    load_balancer *main = init_load_balancer(enable_vnodes);
+    copy_mapped_line(buffer, line, length, REQUEST_TYPE_LENGTH);
+    request_type req_type = get_request_type(buffer);
+
+    if (req_type == ADD_SERVER || req_type == REMOVE_SERVER)
+    {
+        copy_mapped_line(buffer, line, length, REQUEST_LENGTH);
+        read_server_arguments(buffer, req_type, maybe_server_id,
+                              maybe_cache_size, maybe_cache);
+        return req_type;
+    }
+
+    if (req_type == GET_STATS)
+        return req_type;
+
+    char *name_start = memchr(line, '"', length);
+    DIE(name_start == NULL, "document name is not quoted");
+    char *name_end = memchr(name_start + 1, '"', line_end - name_start - 1);
+    DIE(name_end == NULL, "document name is not quoted");
+    *name_end = '\0';
+    *maybe_doc_name = name_start + 1;
+    *maybe_doc_content = NULL;
+
+    if (req_type == EDIT_DOCUMENT)
+    {
+        char *content_start = memchr(name_end + 1, '"',
+                                     line_end - name_end - 1);
+        DIE(content_start == NULL, "document content is not properly quoted");
+        char *content_end = memchr(content_start + 1, '"',
+                                   input->data + input->size -
+                                   content_start - 1);
+        DIE(content_end == NULL, "document content is not properly quoted");
+
+        // the rest of the line holding the closing quote is skipped
+        if (content_end > line_end)
+        {
+            input->position = content_end - input->data;
+            next_mapped_line(input, &length);
+        }
+
+        *content_end = '\0';
+        *maybe_doc_content = blob_create(content_start + 1,
+                                         content_end - content_start);
+    }
+
+    return req_type;
+}
+
+/**
+ * Execution modes enabled by keywords on the first line of the input.
+ */
+typedef struct execution_options
+{
+    bool enable_vnodes;
+    bool coalesce_writes;
+    bool targeted_reads;
+    bool fast_doc_hash;
+    bool threads;
+    bool drain_pool;
+    bool online_rebalance;
+} execution_options;
+
+void read_execution_options(char *buffer, execution_options *options)
+{
+    options->enable_vnodes = strstr(buffer, "ENABLE_VNODES");
+    options->coalesce_writes = strstr(buffer, "ENABLE_WRITE_COALESCING");
+    options->targeted_reads = strstr(buffer, "ENABLE_TARGETED_READS");
+    options->fast_doc_hash = strstr(buffer, "FAST_DOC_HASH");
+    options->threads = strstr(buffer, "ENABLE_THREADS");
+    options->drain_pool = strstr(buffer, "ENABLE_DRAIN_POOL");
+    options->online_rebalance = strstr(buffer, "ENABLE_ONLINE_REBALANCE");
+}
+
+/**
+ * apply_requests() - Reads and serves the requests, from the mapped input if
+ * it is not NULL, or else from the input file.
+ */
+void apply_requests(FILE *input_file, mapped_input *mapped, char *buffer,
+                    int requests_num, execution_options *options)
+{
+    char *doc_name;
+    blob_t *doc_content;
+    char *content_buffer = malloc(DOC_CONTENT_LENGTH + 1);
+    DIE(content_buffer == NULL, "malloc failed");
+    int server_id, cache_size;
+    cache_options cache;
+
+    load_balancer *main = init_load_balancer(options->enable_vnodes);
+    main->coalesce_writes = options->coalesce_writes;
+    main->targeted_reads = options->targeted_reads;
+    if (options->fast_doc_hash)
+        main->hash_function_docs = hash_string_fast;
+    if (options->threads)
+        loader_enable_threads(main);
+    if (options->drain_pool)
+        loader_enable_drain_pool(main);
+    if (options->online_rebalance)
+        loader_enable_online_rebalance(main);
 
     for (int i = 0; i < requests_num; i++)
     {
-        request_type req_type = read_request_arguments(input_file, buffer,
-                                                       &server_id, &cache_size,
-                                                       &doc_name,
-                                                       &doc_content);
+        // the documents of the moved ranges stream between the requests
+        loader_rebalance_step(main);
+
+        request_type req_type;
+        if (mapped)
+            req_type = read_mapped_request_arguments(mapped, buffer,
+                                                     &server_id, &cache_size,
+                                                     &cache,
+                                                     &doc_name,
+                                                     &doc_content);
+        else
+            req_type = read_request_arguments(input_file, buffer,
+                                              &server_id, &cache_size,
+                                              &cache,
+                                              &doc_name,
+                                              content_buffer,
+                                              &doc_content);
 
         if (req_type == ADD_SERVER)
         {
             DIE(cache_size < 0, "cache size must be positive");
-            loader_add_server(main, server_id, (unsigned int)cache_size);
+            cache.capacity = (unsigned int)cache_size;
+            loader_add_server(main, server_id, &cache);
         }
         else if (req_type == REMOVE_SERVER)
         {
             loader_remove_server(main, server_id);
         }
+        else if (req_type == GET_STATS)
+        {
+            loader_print_stats(main);
+        }
         else
         {
             request server_request = {
                 .type = req_type,
-                .doc_name = doc_name,
+                .key = {doc_name, strlen(doc_name), 0},
             };
 
             if (req_type == EDIT_DOCUMENT)
@@ -141,39 +379,67 @@ void apply_requests(FILE *input_file, char *buffer,
                 server_request.doc_content = doc_content;
             }
 
-            response *response = loader_forward_request(main, &server_request);
+            if (main->pipeline)
+            {
+                // the worker releases the content, mapped names live on
+                loader_post_request(main, &server_request, !mapped);
+                continue;
+            }
 
-            free(server_request.doc_name);
-            free(server_request.doc_content);
+            response response;
+            if (loader_forward_request(main, &server_request, &response))
+                print_response(&response);
 
-            PRINT_RESPONSE(response);
+            // mapped names live in the mapping
+            if (!mapped)
+                free(server_request.key.name);
+            blob_release(server_request.doc_content);
         }
     }
     free_load_balancer(&main);
+    free(content_buffer);
 }
 
 int main(int argc, char **argv)
 {
     FILE *input;
     int requests_num;
-    bool enable_vnodes;
+    execution_options options;
 
     char buffer[REQUEST_LENGTH + 1];
 
     if (argc < 2)
     {
-        printf("Usage: %s <input_file>\n", argv[0]);
+        printf("Usage: %s <input_file> [--mmap]\n", argv[0]);
         return -1;
     }
 
+    if (argc > 2 && !strcmp(argv[2], "--mmap"))
+    {
+        mapped_input mapped;
+        size_t length;
+
+        map_input_file(argv[1], &mapped);
+        DIE(mapped.size == 0, "empty input file");
+        char *line = next_mapped_line(&mapped, &length);
+        copy_mapped_line(buffer, line, length, REQUEST_LENGTH);
+        requests_num = atoi(buffer);
+        read_execution_options(buffer, &options);
+
+        apply_requests(NULL, &mapped, buffer, requests_num, &options);
+
+        unmap_input_file(&mapped);
+        return 0;
+    }
+
     input = fopen(argv[1], "rt");
     DIE(input == NULL, "missing input file");
 
     DIE(fgets(buffer, REQUEST_LENGTH + 1, input) == 0, "empty input file");
     requests_num = atoi(buffer);
-    enable_vnodes = strstr(buffer, "ENABLE_VNODES");
+    read_execution_options(buffer, &options);
 
-    apply_requests(input, buffer, requests_num, enable_vnodes);
+    apply_requests(input, NULL, buffer, requests_num, &options);
 
     fclose(input);
 
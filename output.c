@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "output.h"
+#include "utils.h"
+
+static char stdout_buffer[OUTPUT_BUFFER_SIZE];
+static output_sink stdout_sink = {STDOUT_FILENO, 0, OUTPUT_BUFFER_SIZE,
+								  stdout_buffer};
+static int stdout_sink_ready;
+static __thread output_sink *current_sink;
+
+static void output_flush_stdout(void)
+{
+	output_flush(&stdout_sink);
+}
+
+output_sink *output_stdout(void)
+{
+	if (!stdout_sink_ready)
+	{
+		stdout_sink_ready = 1;
+		atexit(output_flush_stdout);
+	}
+	return &stdout_sink;
+}
+
+output_sink *output_current(void)
+{
+	return current_sink ? current_sink : output_stdout();
+}
+
+void output_set_current(output_sink *out)
+{
+	current_sink = out;
+}
+
+void output_memory_init(output_sink *out)
+{
+	out->fd = -1;
+	out->length = 0;
+	out->capacity = OUTPUT_MEMORY_SIZE;
+	out->buffer = malloc(out->capacity);
+	DIE(!out->buffer, "malloc failed");
+}
+
+void output_memory_free(output_sink *out)
+{
+	free(out->buffer);
+	out->buffer = NULL;
+	out->length = out->capacity = 0;
+}
+
+void output_clear(output_sink *out)
+{
+	out->length = 0;
+}
+
+/**
+ * output_grow() - Makes room for a total length in a memory sink.
+ */
+static void output_grow(output_sink *out, size_t length)
+{
+	size_t capacity = out->capacity;
+	while (capacity < length)
+		capacity *= 2;
+
+	char *buffer = realloc(out->buffer, capacity);
+	DIE(!buffer, "realloc failed");
+	out->buffer = buffer;
+	out->capacity = capacity;
+}
+
+/**
+ * output_write_fd() - Writes all the bytes, retrying after partial writes
+ * and interruptions.
+ */
+static void output_write_fd(int fd, const char *data, size_t length)
+{
+	while (length)
+	{
+		ssize_t written = write(fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+		DIE(written < 0, "write failed");
+		data += written;
+		length -= written;
+	}
+}
+
+void output_flush(output_sink *out)
+{
+	if (out->fd < 0)
+		return;
+
+	output_write_fd(out->fd, out->buffer, out->length);
+	out->length = 0;
+}
+
+void output_write(output_sink *out, const char *data, size_t length)
+{
+	if (out->length + length > out->capacity)
+	{
+		if (out->fd < 0)
+		{
+			output_grow(out, out->length + length);
+		}
+		else
+		{
+			output_flush(out);
+			// larger than the whole buffer, it is written directly
+			if (length > out->capacity)
+			{
+				output_write_fd(out->fd, data, length);
+				return;
+			}
+		}
+	}
+
+	memcpy(out->buffer + out->length, data, length);
+	out->length += length;
+}
+
+void output_puts(output_sink *out, const char *string)
+{
+	output_write(out, string, strlen(string));
+}
+
+void output_printf(output_sink *out, const char *format, ...)
+{
+	va_list args;
+	size_t space = out->capacity - out->length;
+
+	va_start(args, format);
+	int length = vsnprintf(out->buffer + out->length, space, format, args);
+	va_end(args);
+	DIE(length < 0, "vsnprintf failed");
+
+	if ((size_t)length < space)
+	{
+		out->length += length;
+		return;
+	}
+
+	// the text did not fit, it is formatted again after a flush or a growth
+	if (out->fd < 0)
+		output_grow(out, out->length + length + 1);
+	else
+		output_flush(out);
+
+	if ((size_t)length < out->capacity - out->length)
+	{
+		va_start(args, format);
+		vsnprintf(out->buffer + out->length, out->capacity - out->length,
+				  format, args);
+		va_end(args);
+		out->length += length;
+		return;
+	}
+
+	char *text = malloc(length + 1);
+	DIE(!text, "malloc failed");
+	va_start(args, format);
+	vsnprintf(text, length + 1, format, args);
+	va_end(args);
+	output_write_fd(out->fd, text, length);
+	free(text);
+}
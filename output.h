@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+/**
+ * Output sink which formats text straight into a large reusable buffer and
+ * writes it to its file descriptor only when the buffer fills up, when it is
+ * flushed, or when the program exits.
+ *
+ * A memory sink (fd < 0) has no file descriptor: its buffer grows instead,
+ * and keeps its capacity when cleared, so it can be reused without new
+ * allocations.
+ */
+#define OUTPUT_BUFFER_SIZE  65536
+#define OUTPUT_MEMORY_SIZE  256
+
+typedef struct output_sink {
+    int fd;
+    size_t length;
+    size_t capacity;
+    char *buffer;
+} output_sink;
+
+/**
+ * output_stdout() - The sink of the standard output, flushed at exit. Text
+ * printed with stdio meanwhile is not ordered with the sink's text.
+ */
+output_sink *output_stdout(void);
+
+/**
+ * output_current() - The sink the responses of the calling thread are
+ * printed in: the standard output, unless the thread set another one.
+ */
+output_sink *output_current(void);
+
+/**
+ * output_set_current() - Redirects the responses of the calling thread to a
+ * sink, or back to the standard output if the sink is NULL.
+ */
+void output_set_current(output_sink *out);
+
+void output_memory_init(output_sink *out);
+
+void output_memory_free(output_sink *out);
+
+void output_clear(output_sink *out);
+
+void output_write(output_sink *out, const char *data, size_t length);
+
+void output_puts(output_sink *out, const char *string);
+
+void output_printf(output_sink *out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * output_flush() - Writes the buffer of a file sink. Memory sinks keep
+ * their text.
+ */
+void output_flush(output_sink *out);
+
+#endif /* OUTPUT_H */
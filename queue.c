@@ -5,6 +5,7 @@
 #include "queue.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 queue_t *init_queue(unsigned int data_size) {
     queue_t *new_queue = malloc(sizeof(queue_t));
@@ -45,3 +46,80 @@ void destroy_queue(queue_t **queue) {
     ll_free(&(*queue)->list);
     free(*queue);
 }
+
+ring_queue_t *init_ring_queue(unsigned int data_size, unsigned int capacity) {
+    ring_queue_t *new_queue = malloc(sizeof(ring_queue_t));
+    new_queue->buffer = malloc((size_t)data_size * capacity);
+    new_queue->data_size = data_size;
+    new_queue->capacity = capacity;
+    new_queue->head = 0;
+    new_queue->size = 0;
+    return new_queue;
+}
+
+unsigned int get_size_ring_queue(ring_queue_t *queue) {
+    return queue->size;
+}
+
+int is_empty_ring_queue(ring_queue_t *queue) {
+    return queue->size == 0;
+}
+
+int is_full_ring_queue(ring_queue_t *queue) {
+    return queue->size == queue->capacity;
+}
+
+void *peek_ring_queue(ring_queue_t *queue) {
+    if (is_empty_ring_queue(queue))
+        return NULL;
+    return queue->buffer + (size_t)queue->head * queue->data_size;
+}
+
+void *get_nth_ring_queue(ring_queue_t *queue, unsigned int n) {
+    if (n >= queue->size)
+        return NULL;
+
+    unsigned int position = queue->head + n;
+    if (position >= queue->capacity)
+        position -= queue->capacity;
+
+    return queue->buffer + (size_t)position * queue->data_size;
+}
+
+int push_ring_queue(ring_queue_t *queue, void *new_data) {
+    if (is_full_ring_queue(queue))
+        return 0;
+
+    unsigned int tail = queue->head + queue->size;
+    if (tail >= queue->capacity)
+        tail -= queue->capacity;
+
+    memcpy(queue->buffer + (size_t)tail * queue->data_size, new_data,
+           queue->data_size);
+    queue->size++;
+    return 1;
+}
+
+void pop_ring_queue(ring_queue_t *queue, void *out_data) {
+    if (is_empty_ring_queue(queue))
+        return;
+
+    if (out_data)
+        memcpy(out_data, peek_ring_queue(queue), queue->data_size);
+
+    queue->head++;
+    if (queue->head == queue->capacity)
+        queue->head = 0;
+    queue->size--;
+}
+
+void clear_ring_queue(ring_queue_t *queue) {
+    queue->head = 0;
+    queue->size = 0;
+}
+
+void destroy_ring_queue(ring_queue_t **queue) {
+    free((*queue)->buffer);
+    free(*queue);
+    *queue = NULL;
+}
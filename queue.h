@@ -28,4 +28,52 @@ void clear_queue(queue_t *queue);
 
 void destroy_queue(queue_t **queue);
 
+/**
+ * Fixed-capacity queue stored in one contiguous circular buffer. Elements
+ * are copied by value into their slot, so pushing and popping never
+ * allocate.
+ */
+typedef struct ring_queue_t ring_queue_t;
+typedef struct ring_queue_t {
+    char *buffer;
+    unsigned int data_size;
+    unsigned int capacity;
+    unsigned int head;
+    unsigned int size;
+} ring_queue_t;
+
+ring_queue_t *init_ring_queue(unsigned int data_size, unsigned int capacity);
+
+unsigned int get_size_ring_queue(ring_queue_t *queue);
+
+int is_empty_ring_queue(ring_queue_t *queue);
+
+int is_full_ring_queue(ring_queue_t *queue);
+
+void *peek_ring_queue(ring_queue_t *queue);
+
+/**
+ * get_nth_ring_queue() - Gets the slot of the n-th element, counting from
+ * the front of the queue, or NULL if there are not enough elements.
+ */
+void *get_nth_ring_queue(ring_queue_t *queue, unsigned int n);
+
+/**
+ * push_ring_queue() - Copies an element at the end of the queue.
+ *
+ * @return int - 1 if the element was pushed, 0 if the queue is full.
+ */
+int push_ring_queue(ring_queue_t *queue, void *new_data);
+
+/**
+ * pop_ring_queue() - Removes the first element of the queue.
+ *
+ * @param out_data: If not NULL, the removed element is copied here.
+ */
+void pop_ring_queue(ring_queue_t *queue, void *out_data);
+
+void clear_ring_queue(ring_queue_t *queue);
+
+void destroy_ring_queue(ring_queue_t **queue);
+
 #endif
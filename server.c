@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include "server.h"
 #include "lru_cache.h"
+#include "output.h"
+#include "drain_pool.h"
 
 #include "utils.h"
 
@@ -49,140 +51,250 @@ unsigned int get_server_replica_executor(server_t *s, unsigned int data_hash)
 	return minimum_index;
 }
 
-static response *server_edit_document(server_t *s,
-									  char *doc_name,
-									  char *doc_content)
+/**
+ * free_evicted_keys() - Frees a list of keys reported by lru_cache_put().
+ */
+static void free_evicted_keys(linked_list_t *evicted_keys)
+{
+	for (ll_node_t *node = evicted_keys->head; node; node = node->next)
+		free(*(char **)node->data);
+	ll_free(&evicted_keys);
+}
+
+/**
+ * print_cache_miss_log() - Prints the log of a request which added a
+ * document to the cache.
+ *
+ * @param doc_name: The document added to the cache.
+ * @param evicted_keys: Keys evicted to make room for the document.
+ */
+static void print_cache_miss_log(output_sink *out, const char *doc_name,
+								 linked_list_t *evicted_keys)
+{
+	unsigned int evicted = ll_get_size(evicted_keys);
+
+	if (evicted == 0)
+	{
+		// document was not in cache
+		output_printf(out, LOG_MISS, doc_name);
+	}
+	else if (evicted == 1)
+	{
+		// a key was evicted from cache
+		output_printf(out, LOG_EVICT, doc_name,
+					  *(char **)evicted_keys->head->data);
+	}
+	else
+	{
+		// the byte budget forced several keys out of the cache
+		output_printf(out, LOG_EVICT_MULTI, doc_name);
+		for (ll_node_t *node = evicted_keys->head; node; node = node->next)
+		{
+			if (node != evicted_keys->head)
+				output_puts(out, EVICTED_KEYS_SEPARATOR);
+			output_puts(out, *(char **)node->data);
+		}
+		output_puts(out, LOG_EVICT_MULTI_END);
+	}
+}
+
+void print_response(response *res)
+{
+	output_sink *out = output_current();
+
+	output_printf(out, RESPONSE_HEADER, res->server_id);
+	switch (res->message)
+	{
+	case RESPONSE_QUEUED:
+		output_printf(out, MSG_A, EDIT_REQUEST, res->doc_name);
+		break;
+	case RESPONSE_OVERRIDDEN:
+		output_printf(out, MSG_B, res->doc_name);
+		break;
+	case RESPONSE_CREATED:
+		output_printf(out, MSG_C, res->doc_name);
+		break;
+	case RESPONSE_DOCUMENT:
+		// a missing document is printed the way printf prints NULL
+		output_puts(out, res->document ? res->document->data : "(null)");
+		break;
+	}
+
+	output_printf(out, LOG_HEADER, res->server_id);
+	switch (res->log)
+	{
+	case LOG_QUEUE_SIZE:
+		output_printf(out, LOG_LAZY_EXEC, res->queue_size);
+		break;
+	case LOG_CACHE_HIT:
+		output_printf(out, LOG_HIT, res->doc_name);
+		break;
+	case LOG_CACHE_MISS:
+		print_cache_miss_log(out, res->doc_name, res->evicted_keys);
+		break;
+	case LOG_DOCUMENT_FAULT:
+		output_printf(out, LOG_FAULT, res->doc_name);
+		break;
+	}
+	output_puts(out, RESPONSE_END);
+
+	response_release(res);
+}
+
+void response_release(response *res)
+{
+	blob_release(res->document);
+	res->document = NULL;
+	if (res->evicted_keys)
+	{
+		free_evicted_keys(res->evicted_keys);
+		res->evicted_keys = NULL;
+	}
+}
+
+/**
+ * server_edit_document() - Applies an EDIT task.
+ *
+ * When the task is superseded by a later EDIT of the same document in the
+ * task queue, the responses are computed exactly as for a full write, but
+ * the content is not copied in the database, since the later EDIT
+ * overwrites it before it can be read. A cached copy is only skipped when
+ * the cache counts entries alone, since a byte budget charges its size.
+ *
+ * @param document: With write coalescing, the database node of the document
+ *      found by an earlier EDIT of the same document, or NULL, in which case
+ *      it is set to the node looked up or created here. NULL otherwise.
+ */
+static void server_edit_document(server_t *s,
+								 doc_key *key,
+								 blob_t *doc_content,
+								 bool superseded,
+								 treap_node_t **document,
+								 response *res)
 {
-	unsigned int replica_executor_index =
-	get_server_replica_executor(s,
-								s->hash_function_docs(doc_name));
+	char *doc_name = key->name;
 
-	response *res = malloc(sizeof(response));
 	res->server_id =
 	calculate_replica_label(s->server_id, s->handler_replica);
-	lru_cache_information key_info =
-	create_lru_cache_information(doc_name, strlen(doc_name) + 1);
-	lru_cache_information value_info =
-	create_lru_cache_information(doc_content, strlen(doc_content) + 1);
+	res->doc_name = doc_name;
+	res->document = NULL;
+	res->evicted_keys = NULL;
+	lru_cache_information key_info = create_lru_cache_key(key);
 	// search in the cache if document is present
-	void *cache_info_document = lru_cache_get(s->cache, &key_info, NULL);
-	server_data_t *server_data = get_server_data_by_name(s, doc_name);
+	bool cache_hit = lru_cache_touch(s->cache, &key_info);
 
-	if (server_data)
+	treap_node_t *node = document ? *document : NULL;
+	if (!node)
+	{
+		treap_node_t **index_value =
+		ht_get_hashed(s->database_index, key->name, key->hash);
+		node = index_value ? *index_value : NULL;
+	}
+
+	if (node)
 	{
 		// document is already created
-		res->server_response = malloc(strlen(MSG_B) - 2 + strlen(doc_name) + 1);
-		sprintf(res->server_response, MSG_B, doc_name);
+		res->message = RESPONSE_OVERRIDDEN;
 
-		free(server_data->content);
-		server_data->content = malloc(strlen(doc_content) + 1);
-		strcpy(server_data->content, doc_content);
+		if (!superseded)
+		{
+			server_data_t *server_data =
+			get_server_data_local_database_node(node);
+			blob_release(server_data->content);
+			server_data->content = blob_acquire(doc_content);
+		}
 	}
 	else
 	{
 		// document is not created
-		res->server_response = malloc(strlen(MSG_C) - 2 + strlen(doc_name) + 1);
-		sprintf(res->server_response, MSG_C, doc_name);
+		res->message = RESPONSE_CREATED;
 
 		server_data_t new_server_data;
-		new_server_data.associated_replica_index = replica_executor_index;
-		new_server_data.content = malloc(strlen(doc_content) + 1);
-		new_server_data.name = malloc(strlen(doc_name) + 1);
-		new_server_data.data_hash = s->hash_function_docs(doc_name);
-		strcpy(new_server_data.content, doc_content);
-		strcpy(new_server_data.name, doc_name);
-		dll_add_tail(s->local_database, &new_server_data);
+		new_server_data.associated_replica_index =
+		get_server_replica_executor(s, key->hash);
+		new_server_data.content = blob_acquire(doc_content);
+		new_server_data.name = arena_strdup(s->document_bytes, doc_name);
+		new_server_data.data_hash = key->hash;
+		node = server_database_add(s, &new_server_data);
 	}
+	if (document)
+		*document = node;
 
-	char *evicted_key = NULL;
-
-	lru_cache_put(s->cache, &key_info, &value_info, (void **)(&evicted_key));
+	/**
+	 * a hit can only evict under a byte budget, and a superseded hit may
+	 * skip the put only without one: otherwise the put charges the new
+	 * size and may evict
+	 **/
+	linked_list_t *evicted_keys = NULL;
+	if (!cache_hit || s->cache->byte_capacity)
+		evicted_keys = ll_create_pooled(sizeof(char *), s->list_nodes);
+	if (!superseded || evicted_keys)
+		lru_cache_put(s->cache, &key_info, doc_content, evicted_keys);
+	STATS_COUNT(s->stats, cache_hit ? STATS_CACHE_HITS : STATS_CACHE_MISSES, 1);
 
-	if (cache_info_document)
+	if (cache_hit)
 	{
-		// document was in cache
-		res->server_log = malloc(strlen(LOG_HIT) - 2 + strlen(doc_name) + 1);
-		sprintf(res->server_log, LOG_HIT, doc_name);
-		free(cache_info_document);
+		// document was in cache, growing it may still evict other keys
+		if (evicted_keys)
+		{
+			STATS_COUNT(s->stats, STATS_CACHE_EVICTIONS,
+						ll_get_size(evicted_keys));
+			free_evicted_keys(evicted_keys);
+		}
+		res->log = LOG_CACHE_HIT;
 	}
 	else
 	{
-		if (!evicted_key)
-		{
-			// document was not in cache
-			res->server_log = malloc(strlen(LOG_MISS) - 2 + strlen(doc_name) + 1);
-			sprintf(res->server_log, LOG_MISS, doc_name);
-		}
-		else
-		{
-			// a key was evicted from cache
-			res->server_log =
-			malloc(strlen(LOG_EVICT) - 4 + strlen(doc_name) + strlen(evicted_key) + 1);
-			sprintf(res->server_log, LOG_EVICT, doc_name, evicted_key);
-			free(evicted_key);
-		}
+		STATS_COUNT(s->stats, STATS_CACHE_EVICTIONS,
+					ll_get_size(evicted_keys));
+		res->log = LOG_CACHE_MISS;
+		res->evicted_keys = evicted_keys;
 	}
-
-	return res;
 }
 
-static response *server_get_document(server_t *s, char *doc_name)
+static void server_get_document(server_t *s, doc_key *key, response *res)
 {
-	response *res = malloc(sizeof(response));
 	res->server_id = calculate_replica_label(s->server_id, s->handler_replica);
+	res->message = RESPONSE_DOCUMENT;
+	res->doc_name = key->name;
+	res->document = NULL;
+	res->evicted_keys = NULL;
 
-	lru_cache_information key_info =
-	create_lru_cache_information(doc_name, strlen(doc_name) + 1);
-	char *evicted_key = NULL;
+	lru_cache_information key_info = create_lru_cache_key(key);
 	// seach if document is stored in cache
-	void *cache_info_document = lru_cache_get(s->cache, &key_info, NULL);
-	if (cache_info_document)
-	{
-		// document was in cache
-		res->server_response = strdup(cache_info_document);
-		lru_cache_information val_info =
-		create_lru_cache_information(res->server_response,
-									 strlen(res->server_response) + 1);
-		res->server_log = malloc(strlen(LOG_HIT) - 2 + strlen(doc_name) + 1);
-		sprintf(res->server_log, LOG_HIT, doc_name);
-		free(cache_info_document);
-		lru_cache_put(s->cache, &key_info, &val_info, NULL);
+	blob_t *cached_document = lru_cache_get(s->cache, &key_info);
+	if (cached_document)
+	{
+		// document was in cache, and is now the most recently used one
+		res->document = cached_document;
+		res->log = LOG_CACHE_HIT;
+		STATS_COUNT(s->stats, STATS_CACHE_HITS, 1);
 	}
 	else
 	{
+		STATS_COUNT(s->stats, STATS_CACHE_MISSES, 1);
 		// document is only stored on local database
-		server_data_t *server_data = get_server_data_by_name(s, doc_name);
+		server_data_t *server_data = get_server_data_by_key(s, key);
 		if (server_data)
 		{
-			lru_cache_information value_info =
-			create_lru_cache_information(server_data->content,
-										 strlen(server_data->content) + 1);
-			lru_cache_put(s->cache, &key_info, &value_info, (void **)(&evicted_key));
-			res->server_response = strdup(server_data->content);
-			if (!evicted_key)
-			{
-				res->server_log = malloc(strlen(LOG_MISS) - 2 + strlen(doc_name) + 1);
-				sprintf(res->server_log, LOG_MISS, doc_name);
-			}
-			else
-			{
-				res->server_log =
-				malloc(strlen(LOG_EVICT) - 4 + strlen(doc_name) + strlen(evicted_key) + 1);
-				sprintf(res->server_log, LOG_EVICT, doc_name, evicted_key);
-				free(evicted_key);
-			}
+			linked_list_t *evicted_keys =
+			ll_create_pooled(sizeof(char *), s->list_nodes);
+			lru_cache_put(s->cache, &key_info, server_data->content,
+						  evicted_keys);
+			STATS_COUNT(s->stats, STATS_CACHE_EVICTIONS,
+						ll_get_size(evicted_keys));
+			res->document = blob_acquire(server_data->content);
+			res->log = LOG_CACHE_MISS;
+			res->evicted_keys = evicted_keys;
 		}
 		else
 		{
-			res->server_response = NULL;
-			res->server_log = malloc(strlen(LOG_FAULT) - 2 + strlen(doc_name) + 1);
-			sprintf(res->server_log, LOG_FAULT, doc_name);
+			res->log = LOG_DOCUMENT_FAULT;
 		}
 	}
-	return res;
 }
 
-server_t *init_server(unsigned int cache_size,
+server_t *init_server(const cache_options *cache,
 					  unsigned int server_id,
 					  unsigned int (*hash_function_servers)(void *),
 					  unsigned int (*hash_function_docs)(void *),
@@ -190,124 +302,444 @@ server_t *init_server(unsigned int cache_size,
 {
 	server_t *server = malloc(sizeof(server_t));
 
-	server->cache = init_lru_cache(cache_size);
-	server->task_queue = init_queue(sizeof(request));
-	server->local_database = dll_create(sizeof(server_data_t));
+	// the cache indexes the documents by the hashes of their key descriptors
+	cache_options options = *cache;
+	options.hash_function = hash_function_docs;
+	server->cache = init_lru_cache(&options);
+	server->task_queue = init_ring_queue(sizeof(request), TASK_QUEUE_SIZE);
+	server->database_index = ht_create_open(DATABASE_INDEX_SIZE,
+											sizeof(treap_node_t *),
+											hash_function_docs,
+											compare_strings);
 	server->server_hash = malloc(replicas * sizeof(unsigned int));
 	server->no_replicas = replicas;
 	server->server_id = server_id;
 	server->hash_function_docs = hash_function_docs;
+	server->pending_writes = NULL;
+	server->coalesce_writes = false;
+	server->targeted_reads = false;
+	server->queue_tombstones = 0;
+	server->queued_since_read = 0;
+	server->worker = NULL;
+	server->drain_pool = NULL;
+	server->draining = 0;
+	server->drained = NULL;
+	server->drained_ahead = 0;
+	server->drained_capacity = 0;
+	server->document_nodes = malloc(sizeof(slab_pool_t));
+	slab_pool_init(server->document_nodes,
+				   sizeof(treap_node_t) + sizeof(server_data_t));
+	server->document_bytes = malloc(sizeof(arena_t));
+	arena_init(server->document_bytes);
+	server->list_nodes = malloc(sizeof(slab_pool_t));
+	slab_pool_init(server->list_nodes, ll_pool_object_size(sizeof(char *)));
+	server->local_database = malloc(replicas * sizeof(treap_t *));
+#ifndef DISABLE_STATS
+	memset(server->stats, 0, sizeof(server->stats));
+#endif
 	for (unsigned int i = 0; i < replicas; i++)
 	{
 		unsigned int label = calculate_replica_label(server->server_id, i);
 		server->server_hash[i] = hash_function_servers(&label);
+		server->local_database[i] =
+		server_database_range(server, server->server_hash[i]);
 	}
 	return server;
 }
 
-response *server_handle_request(server_t *s, request *req)
+bool server_handle_request(server_t *s, request *req, response *res)
 {
+	server_wait_drain(s);
+	STATS_TIMER(start);
+
 	if (req->type == EDIT_DOCUMENT)
 	{
-		response *res = malloc(sizeof(response));
 		res->server_id = calculate_replica_label(s->server_id, req->replica_index);
-		res->server_log = malloc((strlen(LOG_LAZY_EXEC) - 2) + MAX_CHAR_SIZE_INT + 1);
-		res->server_response =
-		malloc((strlen(MSG_A) - 4) + strlen(EDIT_REQUEST) + DOC_NAME_LENGTH + 1);
+		res->message = RESPONSE_QUEUED;
+		res->log = LOG_QUEUE_SIZE;
+		res->doc_name = req->key.name;
+		res->document = NULL;
+		res->evicted_keys = NULL;
 		request copied_req = copy_request(req);
-		push_task_queue(s, &copied_req);
-		sprintf(res->server_log, LOG_LAZY_EXEC, get_size_queue(s->task_queue));
-		sprintf(res->server_response, MSG_A, EDIT_REQUEST, req->doc_name);
-		return res;
+		if (!push_task_queue(s, &copied_req))
+		{
+			free(copied_req.key.name);
+			blob_release(copied_req.doc_content);
+		}
+		res->queue_size = s->queued_since_read;
+		STATS_COUNT(s->stats, STATS_EDITS, 1);
+		STATS_RECORD(STATS_EDIT, start);
+		if (s->drain_pool &&
+			get_size_ring_queue(s->task_queue) >= DRAIN_AHEAD_THRESHOLD)
+			drain_pool_submit(s->drain_pool, s);
+		return true;
 	}
 	else if (req->type == GET_DOCUMENT)
 	{
-		execute_server_task_queue(s);
-		return server_get_document(s, req->doc_name);
+		if (s->targeted_reads)
+		{
+			execute_server_document_tasks(s, &req->key);
+			s->queued_since_read = 0;
+		}
+		else
+			execute_server_task_queue(s);
+		server_get_document(s, &req->key, res);
+		STATS_COUNT(s->stats, STATS_GETS, 1);
+		STATS_RECORD(STATS_GET, start);
+		return true;
 	}
 
-	return NULL;
+	return false;
+}
+
+/**
+ * A pending write counts the queued EDITs of a document and, with write
+ * coalescing, keeps the database node found by the first of them executed,
+ * so the others neither look the document up again nor copy their content.
+ * The node stays valid, since documents only leave a server after its task
+ * queue is drained.
+ */
+typedef struct pending_write
+{
+	unsigned int count;
+	treap_node_t *document;
+} pending_write;
+
+/**
+ * The pending writes index is needed by both write coalescing and targeted
+ * reads, so it exists while any of them is enabled.
+ */
+static void server_update_pending_writes(server_t *s)
+{
+	bool needed = s->coalesce_writes || s->targeted_reads;
+
+	if (needed && !s->pending_writes)
+		s->pending_writes = ht_create_open(PENDING_WRITES_INDEX_SIZE,
+										   sizeof(pending_write),
+										   s->hash_function_docs,
+										   compare_strings);
+	else if (!needed && s->pending_writes)
+	{
+		ht_free(s->pending_writes);
+		s->pending_writes = NULL;
+	}
+}
+
+void server_set_write_coalescing(server_t *s, bool enable)
+{
+	s->coalesce_writes = enable;
+	server_update_pending_writes(s);
+}
+
+void server_set_targeted_reads(server_t *s, bool enable)
+{
+	s->targeted_reads = enable;
+	server_update_pending_writes(s);
+}
+
+void server_set_drain_pool(server_t *s, struct drain_pool *pool)
+{
+	if (!pool)
+	{
+		for (unsigned int i = 0; i < s->drained_ahead; i++)
+		{
+			response_release(&s->drained[i]);
+			free((char *)s->drained[i].doc_name);
+		}
+		free(s->drained);
+		s->drained = NULL;
+		s->drained_ahead = 0;
+		s->drained_capacity = 0;
+	}
+	s->drain_pool = pool;
+}
+
+void server_wait_drain(server_t *s)
+{
+	if (s->drain_pool)
+		drain_pool_wait(s->drain_pool, s);
+}
+
+unsigned int get_task_queue_size(server_t *s)
+{
+	return get_size_ring_queue(s->task_queue) - s->queue_tombstones +
+		   s->drained_ahead;
+}
+
+static void pending_writes_add(server_t *s, doc_key *key)
+{
+	pending_write *pending = ht_emplace_hashed(s->pending_writes, key->name,
+											   key->length + 1, key->hash,
+											   sizeof(pending_write), NULL);
+	pending->count++;
+}
+
+/**
+ * execute_server_task() - Applies a queued EDIT, prints its response and
+ * frees the strings of the request, leaving its slot in the queue.
+ *
+ * @param deferred: If not NULL, the response is stored here instead of
+ *      being printed, and keeps the name of the document.
+ */
+static void execute_server_task(server_t *s, request *rqst,
+								response *deferred)
+{
+	pending_write *pending = NULL;
+	if (s->pending_writes)
+		pending = ht_get_hashed(s->pending_writes, rqst->key.name,
+								rqst->key.hash);
+
+	response edit_response;
+	if (s->coalesce_writes && pending)
+		server_edit_document(s, &rqst->key, rqst->doc_content,
+							 pending->count > 1, &pending->document,
+							 &edit_response);
+	else
+		server_edit_document(s, &rqst->key, rqst->doc_content, false, NULL,
+							 &edit_response);
+
+	// the last queued EDIT of a document releases its pending write
+	if (pending && --pending->count == 0)
+		ht_remove_entry_hashed(s->pending_writes, rqst->key.name,
+							   rqst->key.hash);
+	STATS_COUNT(s->stats, STATS_TASKS, 1);
+	blob_release(rqst->doc_content);
+	if (deferred)
+	{
+		*deferred = edit_response;
+		return;
+	}
+	print_response(&edit_response);
+	free(rqst->key.name);
+}
+
+void server_drain_ahead(server_t *s)
+{
+	while (!is_empty_ring_queue(s->task_queue))
+	{
+		if (s->drained_ahead == s->drained_capacity)
+		{
+			s->drained_capacity = s->drained_capacity ?
+								  2 * s->drained_capacity :
+								  DRAIN_AHEAD_THRESHOLD;
+			s->drained = realloc(s->drained,
+								 s->drained_capacity * sizeof(response));
+			DIE(!s->drained, "realloc failed");
+		}
+		execute_server_task(s, peek_ring_queue(s->task_queue),
+							&s->drained[s->drained_ahead++]);
+		pop_ring_queue(s->task_queue, NULL);
+	}
 }
 
 void execute_server_task_queue(server_t *s)
 {
-	while (!is_empty_queue(s->task_queue))
+	server_wait_drain(s);
+	STATS_TIMER(start);
+	bool drained = !is_empty_ring_queue(s->task_queue) || s->drained_ahead;
+
+	// the tasks executed ahead come first in the queue order
+	for (unsigned int i = 0; i < s->drained_ahead; i++)
+	{
+		response *res = &s->drained[i];
+		char *doc_name = (char *)res->doc_name;
+		res->server_id =
+		calculate_replica_label(s->server_id, s->handler_replica);
+		print_response(res);
+		free(doc_name);
+	}
+	s->drained_ahead = 0;
+
+	while (!is_empty_ring_queue(s->task_queue))
+	{
+		request *rqst = peek_ring_queue(s->task_queue);
+		// tasks already executed by a targeted read are skipped
+		if (rqst->key.name)
+			execute_server_task(s, rqst, NULL);
+		pop_ring_queue(s->task_queue, NULL);
+	}
+	s->queue_tombstones = 0;
+	s->queued_since_read = 0;
+
+	// only the drains which executed tasks are measured
+	if (drained)
 	{
-		request *rqst = peek_queue(s->task_queue);
-		response *edit_response =
-		server_edit_document(s, rqst->doc_name, rqst->doc_content);
-		PRINT_RESPONSE(edit_response);
-		ll_node_t *node = pop_queue(s->task_queue);
-		request_free((request *)node->data);
-		free(node);
+		STATS_COUNT(s->stats, STATS_DRAINS, 1);
+		STATS_RECORD(STATS_DRAIN, start);
 	}
 }
 
+void execute_server_document_tasks(server_t *s, doc_key *key)
+{
+	pending_write *pending = ht_get_hashed(s->pending_writes, key->name,
+										   key->hash);
+	if (!pending)
+		return;
+
+	unsigned int remaining = pending->count;
+	for (unsigned int i = 0; remaining > 0; i++)
+	{
+		request *rqst = get_nth_ring_queue(s->task_queue, i);
+		if (!rqst->key.name || rqst->key.hash != key->hash ||
+			strcmp(rqst->key.name, key->name))
+			continue;
+
+		// the executed task stays in its slot as a tombstone
+		execute_server_task(s, rqst, NULL);
+		rqst->key.name = NULL;
+		rqst->doc_content = NULL;
+		s->queue_tombstones++;
+		remaining--;
+	}
+
+	while (!is_empty_ring_queue(s->task_queue) &&
+		   !((request *)peek_ring_queue(s->task_queue))->key.name)
+	{
+		pop_ring_queue(s->task_queue, NULL);
+		s->queue_tombstones--;
+	}
+}
+
+/**
+ * compact_task_queue() - Drops the tombstones left by targeted reads, keeping
+ * the order of the queued tasks.
+ */
+static void compact_task_queue(server_t *s)
+{
+	unsigned int size = get_size_ring_queue(s->task_queue);
+	for (unsigned int i = 0; i < size; i++)
+	{
+		request rqst;
+		pop_ring_queue(s->task_queue, &rqst);
+		if (rqst.key.name)
+			push_ring_queue(s->task_queue, &rqst);
+	}
+	s->queue_tombstones = 0;
+}
+
 request copy_request(request *req)
 {
-	int name_len = strlen(req->doc_name);
-	int content_len = strlen(req->doc_content);
+	int name_len = req->key.length;
 	request new_req;
-	new_req.doc_content = malloc(content_len + 1);
-	new_req.doc_name = malloc(name_len + 1);
+	// the content is shared, not copied
+	new_req.doc_content = blob_acquire(req->doc_content);
+	new_req.key = req->key;
+	new_req.key.name = malloc(name_len + 1);
 	new_req.type = req->type;
 	new_req.replica_index = req->replica_index;
-	new_req.doc_name[name_len] = 0;
-	new_req.doc_content[content_len] = 0;
-	memcpy(new_req.doc_content, req->doc_content, content_len);
-	memcpy(new_req.doc_name, req->doc_name, name_len);
+	new_req.key.name[name_len] = 0;
+	memcpy(new_req.key.name, req->key.name, name_len);
 	return new_req;
 }
 
 void free_server(server_t **s)
 {
+	// the tasks executed ahead are dropped, like the queued ones
+	server_wait_drain(*s);
+	server_set_drain_pool(*s, NULL);
 	free_lru_cache(&(*s)->cache);
-	while (!is_empty_queue((*s)->task_queue))
+	while (!is_empty_ring_queue((*s)->task_queue))
 	{
-		ll_node_t *node = pop_queue((*s)->task_queue);
-		request_free((request *)node->data);
-		free(node);
+		request *rqst = peek_ring_queue((*s)->task_queue);
+		free(rqst->key.name);
+		blob_release(rqst->doc_content);
+		pop_ring_queue((*s)->task_queue, NULL);
 	}
-	destroy_queue(&((*s)->task_queue));
+	destroy_ring_queue(&((*s)->task_queue));
+	if ((*s)->pending_writes)
+		ht_free((*s)->pending_writes);
 
-	while (dll_get_size((*s)->local_database) != 0)
+	/**
+	 * the nodes and the names of the documents are released in bulk, only
+	 * the references to the contents are dropped one by one
+	 */
+	for (unsigned int i = 0; i < (*s)->no_replicas; i++)
 	{
-		dll_node_t *rm_node = dll_remove_nth_node((*s)->local_database, 0);
-		server_data_t *sd = get_server_data_local_database_node(rm_node);
-		server_data_free(sd);
-		free(rm_node);
+		treap_node_t *sd_node = treap_first((*s)->local_database[i]);
+		for (; sd_node; sd_node = treap_next(sd_node))
+			blob_release(get_server_data_local_database_node(sd_node)->content);
+		treap_abandon(&(*s)->local_database[i]);
 	}
+	slab_pool_release((*s)->document_nodes);
+	arena_release((*s)->document_bytes);
+	slab_pool_release((*s)->list_nodes);
+	free((*s)->document_nodes);
+	free((*s)->document_bytes);
+	free((*s)->list_nodes);
+	free((*s)->local_database);
 	free((*s)->server_hash);
-	dll_free(&((*s)->local_database));
+	ht_free((*s)->database_index);
 	free(*s);
 	*s = NULL;
 }
 
 server_data_t *
-get_server_data_local_database_node(dll_node_t *local_database_node)
+get_server_data_local_database_node(treap_node_t *local_database_node)
 {
 	return (server_data_t *)local_database_node->data;
 }
 
-void push_task_queue(server_t *s, void *data)
+unsigned int get_server_database_size(server_t *server)
+{
+	unsigned int size = 0;
+	for (unsigned int i = 0; i < server->no_replicas; i++)
+		size += treap_get_size(server->local_database[i]);
+	return size;
+}
+
+int push_task_queue(server_t *s, void *data)
+{
+	/**
+	 * the limit counts the EDITs received since the last drain, or since the
+	 * last GET with targeted reads, whether they are still queued or were
+	 * executed ahead
+	 */
+	if (s->queued_since_read >= TASK_QUEUE_SIZE)
+		return 0;
+
+	if (s->targeted_reads)
+	{
+		/**
+		 * EDITs of other documents outlive the GETs, so the oldest tasks
+		 * are executed when the queue itself runs out of slots
+		 */
+		if (is_full_ring_queue(s->task_queue) && s->queue_tombstones > 0)
+			compact_task_queue(s);
+
+		if (is_full_ring_queue(s->task_queue))
+		{
+			execute_server_task(s, peek_ring_queue(s->task_queue), NULL);
+			pop_ring_queue(s->task_queue, NULL);
+		}
+	}
+
+	if (!push_ring_queue(s->task_queue, data))
+		return 0;
+	s->queued_since_read++;
+
+	if (s->pending_writes)
+		pending_writes_add(s, &((request *)data)->key);
+	return 1;
+}
+
+void server_data_free(server_t *server, server_data_t *server_data)
 {
-	if (get_size_queue(s->task_queue) < TASK_QUEUE_SIZE)
-		push_queue(s->task_queue, data);
+	blob_release(server_data->content);
+	arena_free_string(server->document_bytes, server_data->name);
 }
 
-void server_data_free(server_data_t *server_data)
+treap_t *server_database_range(server_t *server, unsigned int origin)
 {
-	free(server_data->content);
-	free(server_data->name);
-	free(server_data);
+	return treap_create_pooled(sizeof(server_data_t), origin,
+							   server->document_nodes);
 }
 
 void request_free(request *req)
 {
 	if (req)
 	{
-		free(req->doc_content);
-		free(req->doc_name);
+		blob_release(req->doc_content);
+		free(req->key.name);
 		free(req);
 	}
 }
@@ -321,24 +753,27 @@ void print_server(server_t *server)
 			   calculate_replica_label(server->server_id, i), server->server_hash[i],
 			   number_digits(server->server_hash[i]));
 	printf("--------DATA--------\n");
-	printf("--------NO. DATA - %u--------\n", server->local_database->size);
-	dll_node_t *sd_node = server->local_database->head;
-	while (sd_node)
+	printf("--------NO. DATA - %u--------\n", get_server_database_size(server));
+	for (unsigned int i = 0; i < server->no_replicas; i++)
 	{
-		server_data_t *sd = get_server_data_local_database_node(sd_node);
-		print_server_data(sd);
-		sd_node = dll_get_next_node(server->local_database, sd_node);
+		treap_node_t *sd_node = treap_first(server->local_database[i]);
+		while (sd_node)
+		{
+			server_data_t *sd = get_server_data_local_database_node(sd_node);
+			print_server_data(sd);
+			sd_node = treap_next(sd_node);
+		}
 	}
 	printf("--------TASK QUEUE SIZE: %u--------\n",
-		   get_size_queue(server->task_queue));
-	if (!is_empty_queue(server->task_queue))
+		   get_task_queue_size(server));
+	if (!is_empty_ring_queue(server->task_queue))
 	{
-		request *req = peek_queue(server->task_queue);
+		request *req = peek_ring_queue(server->task_queue);
 		printf("TASK QUEUE TOP KEY: %s -------- VALUE: %s - HASH - %u - %u\n",
-			   req->doc_name,
-			   req->doc_content,
-			   server->hash_function_docs(req->doc_name),
-			   number_digits(server->hash_function_docs(req->doc_name)));
+			   req->key.name,
+			   req->doc_content->data,
+			   req->key.hash,
+			   number_digits(req->key.hash));
 	}
 	print_lru_cache(server->cache);
 }
@@ -355,19 +790,238 @@ void print_server_data(server_data_t *server_data)
 
 server_data_t *get_server_data_by_name(server_t *server, char *name)
 {
-	dll_node_t *server_data_node = server->local_database->head;
+	doc_key key = create_doc_key(name, strlen(name), server->hash_function_docs);
+
+	return get_server_data_by_key(server, &key);
+}
+
+server_data_t *get_server_data_by_key(server_t *server, doc_key *key)
+{
+	void *index_value =
+	ht_get_hashed(server->database_index, key->name, key->hash);
+
+	if (!index_value)
+		return NULL;
+
+	return get_server_data_local_database_node(*((treap_node_t **)index_value));
+}
+
+treap_node_t *server_database_add(server_t *server, server_data_t *server_data)
+{
+	treap_node_t *local_database_node =
+	treap_insert(server->local_database[server_data->associated_replica_index],
+				 server_data->data_hash,
+				 server_data);
 
-	while (server_data_node)
+	ht_upsert_hashed(server->database_index,
+					 server_data->name,
+					 strlen(server_data->name) + 1,
+					 server_data->data_hash,
+					 &local_database_node,
+					 sizeof(treap_node_t *));
+
+	return local_database_node;
+}
+
+void server_database_remove(server_t *server,
+							treap_node_t *local_database_node)
+{
+	server_data_t *server_data =
+	get_server_data_local_database_node(local_database_node);
+
+	ht_remove_entry_hashed(server->database_index, server_data->name,
+						   server_data->data_hash);
+	treap_remove_node(server->local_database[server_data->associated_replica_index],
+					  local_database_node);
+}
+
+static void server_document_transfer(server_t *source,
+									 server_data_t *server_data,
+									 server_t *destination)
+{
+	if (source)
 	{
-		server_data_t *sd = get_server_data_local_database_node(server_data_node);
-		if (strcmp(sd->name, name) == 0)
-			return sd;
+		doc_key key = {server_data->name, strlen(server_data->name),
+					   server_data->data_hash};
+		lru_cache_information cache_key = create_lru_cache_key(&key);
+		ht_remove_entry_hashed(source->database_index, server_data->name,
+							   server_data->data_hash);
+		lru_cache_remove(source->cache, &cache_key);
+	}
+
+	// the name moves to the arena of the destination, the content
+	// keeps its reference
+	server_data_t moved = *server_data;
+	moved.name = arena_strdup(destination->document_bytes,
+							  server_data->name);
+	moved.associated_replica_index =
+	get_associated_label_index_for_data(destination, &moved);
+	server_database_add(destination, &moved);
+	STATS_COUNT(destination->stats, STATS_DOCUMENTS_MIGRATED, 1);
+	STATS_COUNT(destination->stats, STATS_BYTES_MIGRATED,
+				moved.content ? moved.content->size : 0);
+	if (source)
+		arena_free_string(source->document_bytes, server_data->name);
+}
+
+void server_database_transfer(server_t *source, treap_t *moving,
+							  server_t *destination)
+{
+	server_wait_drain(destination);
+	ht_reserve(destination->database_index, treap_get_size(moving));
+	treap_node_t *sd_node = treap_first(moving);
+	while (sd_node)
+	{
+		server_document_transfer(source,
+								 get_server_data_local_database_node(sd_node),
+								 destination);
+		sd_node = treap_next(sd_node);
+	}
+}
+
+void server_database_adopt(server_t *heir, server_t *source, bool index)
+{
+	slab_pool_adopt(heir->document_nodes, source->document_nodes);
+	arena_adopt(heir->document_bytes, source->document_bytes);
+	if (!index)
+		return;
+
+	// the heir indexes its own documents in the index it takes over
+	hashtable_t *own_index = heir->database_index;
+	heir->database_index = source->database_index;
+	source->database_index = own_index;
+	ht_reserve(heir->database_index, get_server_database_size(heir));
+	for (unsigned int i = 0; i < heir->no_replicas; i++)
+	{
+		treap_node_t *sd_node = treap_first(heir->local_database[i]);
+		for (; sd_node; sd_node = treap_next(sd_node))
+		{
+			server_data_t *server_data =
+			get_server_data_local_database_node(sd_node);
+			ht_upsert_hashed(heir->database_index,
+							 server_data->name,
+							 strlen(server_data->name) + 1,
+							 server_data->data_hash,
+							 &sd_node,
+							 sizeof(treap_node_t *));
+		}
+	}
+}
+
+void server_database_splice(server_t *destination, treap_t *moving,
+							unsigned int label_index,
+							hashtable_t *adopted_index)
+{
+	server_wait_drain(destination);
+	treap_t *arc = destination->local_database[label_index];
+	treap_node_t *first = treap_first(moving);
+	if (!first)
+		return;
 
-		server_data_node =
-		dll_get_next_node(server->local_database, server_data_node);
+	/**
+	 * the range lies right before the arc of the label, so it is appended
+	 * after its documents; only labels with equal hashes interleave them
+	 **/
+	treap_node_t *last = treap_last(arc);
+	bool append = treap_distance(arc, first->key) <=
+				  treap_distance(arc, treap_last(moving)->key) &&
+				  (!last || treap_distance(arc, last->key) <=
+				   treap_distance(arc, first->key));
+	bool indexed = adopted_index == destination->database_index;
+	if (!indexed)
+		ht_reserve(destination->database_index, treap_get_size(moving));
+	unsigned int documents = 0;
+	size_t bytes = 0;
+	treap_node_t *next;
+	for (treap_node_t *sd_node = first; sd_node; sd_node = next)
+	{
+		next = treap_next(sd_node);
+		server_data_t *server_data = get_server_data_local_database_node(sd_node);
+		documents++;
+		bytes += server_data->content ? server_data->content->size : 0;
+		if (adopted_index && !indexed)
+			ht_remove_entry_hashed(adopted_index, server_data->name,
+								   server_data->data_hash);
+		if (append)
+		{
+			server_data->associated_replica_index = label_index;
+		}
+		else
+		{
+			// the node itself is relinked, the removal keeps its successor
+			treap_remove_node(moving, sd_node);
+			server_data->associated_replica_index =
+			get_associated_label_index_for_data(destination, server_data);
+			treap_insert_node(destination->local_database[
+							  server_data->associated_replica_index], sd_node);
+		}
+
+		if (!indexed)
+			ht_upsert_hashed(destination->database_index,
+							 server_data->name,
+							 strlen(server_data->name) + 1,
+							 server_data->data_hash,
+							 &sd_node,
+							 sizeof(treap_node_t *));
+	}
+
+	STATS_COUNT(destination->stats, STATS_DOCUMENTS_MIGRATED, documents);
+	STATS_COUNT(destination->stats, STATS_BYTES_MIGRATED, bytes);
+	if (append)
+		treap_merge_far(arc, moving);
+}
+
+void server_database_move(server_t *source, treap_t *moving,
+						  treap_node_t *node, server_t *destination)
+{
+	server_wait_drain(source);
+	server_wait_drain(destination);
+	server_document_transfer(source, get_server_data_local_database_node(node),
+							 destination);
+	treap_remove_node(moving, node);
+	treap_node_free(moving, node);
+}
+
+typedef struct range_match_args
+{
+	server_t *server;
+	treap_t *moving;
+} range_match_args;
+
+static bool range_match(const char *key, unsigned int hash, void *arg)
+{
+	range_match_args *args = arg;
+	treap_node_t **node = ht_get_hashed(args->server->database_index,
+										(void *)key, hash);
+	return node && treap_contains(args->moving, *node);
+}
+
+void server_cache_release_range(server_t *server, treap_t *moving)
+{
+	server_wait_drain(server);
+
+	/**
+	 * a small range is looked up in the cache document by document,
+	 * otherwise the cache is scanned, so the cost is bounded by the
+	 * smaller of the two
+	 **/
+	if (treap_get_size(moving) <= server->cache->size)
+	{
+		for (treap_node_t *sd_node = treap_first(moving); sd_node;
+			 sd_node = treap_next(sd_node))
+		{
+			server_data_t *server_data =
+			get_server_data_local_database_node(sd_node);
+			doc_key key = {server_data->name, strlen(server_data->name),
+						   server_data->data_hash};
+			lru_cache_information cache_key = create_lru_cache_key(&key);
+			lru_cache_remove(server->cache, &cache_key);
+		}
+		return;
 	}
 
-	return NULL;
+	range_match_args args = {server, moving};
+	lru_cache_remove_if(server->cache, range_match, &args);
 }
 
 unsigned int calculate_replica_label(unsigned int server_id,
@@ -9,28 +9,73 @@
 #include "constants.h"
 #include "lru_cache.h"
 #include "queue.h"
+#include "treap.h"
+#include "slab.h"
+#include "stats.h"
 #define TASK_QUEUE_SIZE 1000
 #define MAX_LOG_LENGTH 100
 #define MAX_RESPONSE_LENGTH 4096
 #define REPLICA_OFFSET 100000
 #define MAX_REPLICAS 3
+// initial capacity of the name index, which grows with the documents
+#define DATABASE_INDEX_SIZE 256
+#define PENDING_WRITES_INDEX_SIZE 64
+#define DRAIN_AHEAD_THRESHOLD 32
 
+struct server_worker;
+struct drain_pool;
+struct response;
+
+/**
+ * The local database keeps one treap per replica label, holding the
+ * documents of that label's arc ordered by their ring distance to the
+ * label, so a joining label takes over a single contiguous range.
+ *
+ * The treap nodes of the documents come from a pool of the server and
+ * their names from its arena, so a removed server releases them in bulk
+ * instead of one by one, or hands them over to a server which adopts them.
+ */
 typedef struct server
 {
     lru_cache *cache;
-    queue_t *task_queue;
-    doubly_linked_list_t *local_database;
+    ring_queue_t *task_queue;
+    treap_t **local_database;
+    slab_pool_t *document_nodes;
+    arena_t *document_bytes;
+    slab_pool_t *list_nodes;
+    hashtable_t *database_index;
+    hashtable_t *pending_writes;
+    bool coalesce_writes;
+    bool targeted_reads;
+    unsigned int queue_tombstones;
+    unsigned int queued_since_read;
     unsigned int server_id;
     unsigned int *server_hash;
     unsigned int no_replicas;
     unsigned int handler_replica;
     unsigned int (*hash_function_docs)(void *);
+    // thread handling the requests of the server, NULL when not threaded
+    struct server_worker *worker;
+    // pool executing the task queue ahead of the drains, NULL if none
+    struct drain_pool *drain_pool;
+    // set while the server has a job in the pool
+    int draining;
+    /**
+     * responses of the tasks executed ahead, printed by the next drain with
+     * the replica label which handles it
+     */
+    struct response *drained;
+    unsigned int drained_ahead;
+    unsigned int drained_capacity;
+#ifndef DISABLE_STATS
+    stats_counters stats;
+#endif
 } server_t;
 
 typedef struct server_data
 {
     char *name;
-    char *content;
+    blob_t *content;
     unsigned int data_hash;
     unsigned int associated_replica_index;
 } server_data_t;
@@ -39,18 +84,52 @@ typedef struct request
 {
     request_type type;
     unsigned int replica_index;
-    char *doc_name;
-    char *doc_content;
+    doc_key key;
+    blob_t *doc_content;
 } request;
 
+typedef enum response_message
+{
+    RESPONSE_QUEUED,
+    RESPONSE_OVERRIDDEN,
+    RESPONSE_CREATED,
+    RESPONSE_DOCUMENT
+} response_message;
+
+typedef enum response_log
+{
+    LOG_QUEUE_SIZE,
+    LOG_CACHE_HIT,
+    LOG_CACHE_MISS,
+    LOG_DOCUMENT_FAULT
+} response_log;
+
+/**
+ * A response keeps the kinds and the arguments of its message and log
+ * instead of formatted strings; print_response() formats them straight in
+ * the output buffer. Responses live on the caller's stack and borrow the
+ * document name of their request, so they are printed before the request's
+ * strings are freed. A response carrying a document shares its content
+ * through the document blob, and a cache miss holds the evicted keys.
+ */
 typedef struct response
 {
-    char *server_log;
-    char *server_response;
+    response_message message;
+    response_log log;
+    const char *doc_name;
+    blob_t *document;
+    linked_list_t *evicted_keys;
+    unsigned int queue_size;
     int server_id;
 } response;
 
-server_t *init_server(unsigned int cache_size,
+/**
+ * init_server() - Creates a server with an empty database.
+ *
+ * @param cache: Entry limit, byte limit (0 for no limit) and eviction
+ *      policy of the server's cache.
+ */
+server_t *init_server(const cache_options *cache,
                       unsigned int server_id,
                       unsigned int (*hash_function_servers)(void *),
                       unsigned int (*hash_function_docs)(void *),
@@ -63,22 +142,90 @@ server_t *init_server(unsigned int cache_size,
  */
 void free_server(server_t **s);
 
+/**
+ * server_set_write_coalescing() - Enables or disables the coalescing of
+ * queued EDITs. Should be called while the task queue is empty.
+ *
+ * @param s: The server.
+ * @param enable: When enabled, draining the task queue looks each document
+ *      up once, at its first queued EDIT, and only its last queued EDIT
+ *      writes the content. The superseded ones still produce their own
+ *      responses, identical to the ones of a full write.
+ */
+void server_set_write_coalescing(server_t *s, bool enable);
+
+/**
+ * server_set_targeted_reads() - Enables or disables targeted read-your-writes.
+ * Should be called while the task queue is empty.
+ *
+ * @param s: The server.
+ * @param enable: When enabled, a GET executes only the queued EDITs of the
+ *      requested document, instead of the whole task queue. The other EDITs
+ *      stay queued until a later drain. The queue limit and the lazy
+ *      execution log still count the EDITs received since the server's last
+ *      GET, as if every GET emptied the queue.
+ */
+void server_set_targeted_reads(server_t *s, bool enable);
+
+/**
+ * server_set_drain_pool() - Lets a pool execute the task queue of a server
+ * ahead of its drains, once it holds DRAIN_AHEAD_THRESHOLD EDITs. Should not
+ * be used with targeted reads or write coalescing.
+ *
+ * @param s: The server.
+ * @param pool: The pool. The responses of the tasks it executes are kept
+ *      by the server, with the names of their documents, and printed by its
+ *      next drain, so the output does not change.
+ */
+void server_set_drain_pool(server_t *s, struct drain_pool *pool);
+
+/**
+ * server_drain_ahead() - Executes the whole task queue, keeping the
+ * responses for the next drain. Called by the threads of the drain pool.
+ */
+void server_drain_ahead(server_t *s);
+
+/**
+ * server_wait_drain() - Waits for the job of a server in its drain pool,
+ * if it has one. The handlers of the server call it first, and so should
+ * any caller setting the handler replica or reading the counters.
+ */
+void server_wait_drain(server_t *s);
+
+/**
+ * get_task_queue_size() - Gets the number of EDITs still waiting in the
+ * task queue of a server, the ones executed ahead included.
+ */
+unsigned int get_task_queue_size(server_t *s);
+
 /**
  * server_handle_request() - Receives a request from the load balancer
  *      and processes it according to the request type
  *
  * @param s: Server which processes the request.
  * @param req: Request to be processed.
+ * @param res: Filled with the response of the requested operation, which
+ *      will then be printed in main.
  *
- * @return response*: Response of the requested operation, which will
- *      then be printed in main.
+ * @return bool - true if the request has a response.
  *
  * @brief Based on the type of request, should call the appropriate
  *     solver, and should execute the tasks from queue if needed (in
- *     this case, after executing each task, PRINT_RESPONSE should
+ *     this case, after executing each task, print_response() should
  *     be called).
  */
-response *server_handle_request(server_t *s, request *req);
+bool server_handle_request(server_t *s, request *req, response *res);
+
+/**
+ * print_response() - Formats a response in the current output sink of the
+ * calling thread and releases the document and evicted keys it holds.
+ */
+void print_response(response *res);
+
+/**
+ * response_release() - Releases what a response holds without printing it.
+ */
+void response_release(response *res);
 
 /**
  * get_server_data_local_database_node() - Gets the data stored in the
@@ -88,9 +235,29 @@ response *server_handle_request(server_t *s, request *req);
  * @returns server_data_t* - Data from the local database node.
 */
 server_data_t *
-get_server_data_local_database_node(dll_node_t *local_database_node);
+get_server_data_local_database_node(treap_node_t *local_database_node);
 
-void server_data_free(server_data_t *server_data);
+/**
+ * get_server_database_size() - Gets the number of documents stored in the
+ * local database of a server, over all its replica arcs.
+*/
+unsigned int get_server_database_size(server_t *server);
+
+/**
+ * server_data_free() - Gives the name of a document back to the arena of its
+ * server and drops its reference to the content. The data itself lives in
+ * its database node.
+*/
+void server_data_free(server_t *server, server_data_t *server_data);
+
+/**
+ * server_database_range() - Creates an empty treap which can receive a
+ * range split off, or merged from, the local database of a server.
+ * 
+ * @param server: Server whose documents are moved.
+ * @param origin: Origin hash of the new treap.
+*/
+treap_t *server_database_range(server_t *server, unsigned int origin);
 
 /**
  * push_task_queue() - Pushes request to task queue until limit
@@ -98,8 +265,9 @@ void server_data_free(server_data_t *server_data);
  * 
  * @param s: Server on which queue will be executed.
  * @param data: Data pushed to the task queue.
+ * @return int - 1 if the request was queued, 0 if the queue is full.
 */
-void push_task_queue(server_t *s, void *data);
+int push_task_queue(server_t *s, void *data);
 
 void request_free(request *req);
 
@@ -119,7 +287,7 @@ request copy_request(request *req);
 
 /**
  * get_server_data_by_name() - Gets the data of the document with
- * a specific name.
+ * a specific name, using the local database name index.
  * 
  * @param server: Server on which the search will be done.
  * @param name: The name of the document.
@@ -127,6 +295,112 @@ request copy_request(request *req);
 */
 server_data_t *get_server_data_by_name(server_t *server, char *name);
 
+/**
+ * get_server_data_by_key() - Same as get_server_data_by_name(), reusing
+ * the hash of the key.
+ * 
+ * @param server: Server on which the search will be done.
+ * @param key: The key of the document.
+ * @return server_data_t* - The data of the document found.
+*/
+server_data_t *get_server_data_by_key(server_t *server, doc_key *key);
+
+/**
+ * server_database_add() - Stores a document in the arc of its associated
+ * replica and indexes it by name.
+ * 
+ * @param server: Server on which the document is stored.
+ * @param server_data: The document, which is copied inside the database.
+ * @return treap_node_t* - The local database node of the document.
+*/
+treap_node_t *server_database_add(server_t *server, server_data_t *server_data);
+
+/**
+ * server_database_remove() - Unlinks a document from the local database and
+ * from the name index. The node and its data are not freed.
+ * 
+ * @param server: Server on which the document is stored.
+ * @param local_database_node: The local database node of the document.
+*/
+void server_database_remove(server_t *server,
+                            treap_node_t *local_database_node);
+
+/**
+ * server_database_transfer() - Stores on a server the documents of a range
+ * detached from another server's local database.
+ * 
+ * @param source: Server from which the range was detached, whose name index
+ * and cache still reference the documents, or NULL if the source is freed
+ * right after the transfer.
+ * @param moving: The detached range, created by server_database_range() on
+ * the source. The documents, names and contents included, are copied on the
+ * destination under the matching replica label; the caller frees the range.
+ * @param destination: Server receiving the documents.
+*/
+void server_database_transfer(server_t *source, treap_t *moving,
+                              server_t *destination);
+
+/**
+ * server_database_adopt() - Moves the document pool and arena of a server
+ * which is freed next into the ones of another server, so the nodes and
+ * names of its documents outlive it.
+ * 
+ * @param index: Also swap the name indexes, when the heir takes over most
+ * of the documents: it then only indexes its own documents again.
+*/
+void server_database_adopt(server_t *heir, server_t *source, bool index);
+
+/**
+ * server_database_splice() - Stores on a server a range detached from the
+ * local database of a removed server, whose pools were adopted, by linking
+ * its nodes under a replica label instead of copying them. Only the name
+ * index is updated document by document.
+ * 
+ * @param moving: The detached range, which lies right before the arc of the
+ * label. If labels with equal hashes interleave its documents with the arc's
+ * ones, its nodes are relinked one by one instead. It is left empty, and the
+ * caller frees it with treap_abandon().
+ * @param label_index: Index of the replica label taking the range over.
+ * @param adopted_index: Name index of the removed server, if another server
+ * adopts it: the range is then dropped from it, or not indexed again when
+ * the destination is the adopter. NULL otherwise.
+*/
+void server_database_splice(server_t *destination, treap_t *moving,
+                            unsigned int label_index,
+                            hashtable_t *adopted_index);
+
+/**
+ * server_database_move() - Stores on a server one document of a range
+ * detached from another server's local database, and frees its node.
+ * 
+ * @param source: Server from which the range was detached, whose name index
+ * still references the document.
+ * @param moving: The detached range.
+ * @param node: Node of the document inside the range.
+ * @param destination: Server receiving the document.
+*/
+void server_database_move(server_t *source, treap_t *moving,
+                          treap_node_t *node, server_t *destination);
+
+/**
+ * server_cache_release_range() - Removes from the cache of a server the
+ * documents of a range detached from its local database, as a transfer
+ * would, before they are actually moved.
+ * 
+ * @param server: Server from which the range was detached.
+ * @param moving: The detached range.
+*/
+void server_cache_release_range(server_t *server, treap_t *moving);
+
+/**
+ * execute_server_document_tasks() - Executes, in queue order, only the
+ * queued EDITs of a specific document, leaving the others queued.
+ * 
+ * @param s: Server whose task queue is searched.
+ * @param key: Key of the document.
+*/
+void execute_server_document_tasks(server_t *s, doc_key *key);
+
 /**
  * execute_server_task_queue() - Executes the whole task queue and
  * empties it.
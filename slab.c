@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+#include "utils.h"
+
+struct slab_chunk {
+	slab_chunk *next;
+};
+
+struct arena_block {
+	arena_block *prev, *next;
+};
+
+void slab_pool_init(slab_pool_t *pool, unsigned int object_size)
+{
+	// a free object holds the link of the free list
+	if (object_size < sizeof(void *))
+		object_size = sizeof(void *);
+
+	pool->object_size = (object_size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+	pool->free_list = NULL;
+	pool->chunks = NULL;
+	pool->next_object = NULL;
+	pool->chunk_end = NULL;
+	pool->objects = 0;
+}
+
+/**
+ * slab_grow() - Allocates a new chunk, whose objects are handed out in
+ * order, without linking them in the free list first.
+ */
+static void slab_grow(slab_pool_t *pool)
+{
+	size_t objects = SLAB_CHUNK_SIZE / pool->object_size;
+	if (!objects)
+		objects = 1;
+
+	size_t header = (sizeof(slab_chunk) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+	slab_chunk *chunk = malloc(header + objects * pool->object_size);
+	DIE(!chunk, "malloc failed");
+
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->next_object = (char *)chunk + header;
+	pool->chunk_end = pool->next_object + objects * pool->object_size;
+}
+
+void *slab_alloc(slab_pool_t *pool)
+{
+	void *object;
+
+	if (pool->free_list)
+	{
+		object = pool->free_list;
+		pool->free_list = *(void **)object;
+	}
+	else
+	{
+		if (pool->next_object == pool->chunk_end)
+			slab_grow(pool);
+		object = pool->next_object;
+		pool->next_object += pool->object_size;
+	}
+
+	pool->objects++;
+	return object;
+}
+
+void slab_free(slab_pool_t *pool, void *object)
+{
+	if (!object)
+		return;
+
+	*(void **)object = pool->free_list;
+	pool->free_list = object;
+	pool->objects--;
+}
+
+void slab_pool_release(slab_pool_t *pool)
+{
+	slab_chunk *chunk = pool->chunks;
+	while (chunk)
+	{
+		slab_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	slab_pool_init(pool, pool->object_size);
+}
+
+void slab_pool_adopt(slab_pool_t *pool, slab_pool_t *other)
+{
+	// the objects never handed out by the other pool are freed one by one
+	for (char *object = other->next_object; object != other->chunk_end;
+		 object += other->object_size)
+	{
+		*(void **)object = pool->free_list;
+		pool->free_list = object;
+	}
+
+	if (other->free_list)
+	{
+		void **tail = other->free_list;
+		while (*tail)
+			tail = *tail;
+		*tail = pool->free_list;
+		pool->free_list = other->free_list;
+	}
+
+	if (other->chunks)
+	{
+		slab_chunk *last = other->chunks;
+		while (last->next)
+			last = last->next;
+		last->next = pool->chunks;
+		pool->chunks = other->chunks;
+	}
+
+	pool->objects += other->objects;
+	slab_pool_init(other, other->object_size);
+}
+
+/**
+ * arena_class() - Index of the smallest class a block fits in. The first
+ * four classes are multiples of 16 bytes, then every power of two range
+ * (2^p, 2^(p + 1)] is split in four classes.
+ */
+static unsigned int arena_class(size_t size)
+{
+	if (size <= 64)
+		return size ? (size + 15) / 16 - 1 : 0;
+
+	unsigned int power = 63 - __builtin_clzll(size - 1);
+	size_t step = (size_t)1 << (power - 2);
+	size_t quarter = (size - ((size_t)1 << power) + step - 1) / step;
+	return 4 + (power - 6) * 4 + quarter - 1;
+}
+
+static size_t arena_class_size(unsigned int index)
+{
+	if (index < 4)
+		return 16 * (index + 1);
+
+	unsigned int power = 6 + (index - 4) / 4;
+	return ((size_t)1 << power) + ((index - 4) % 4 + 1) *
+		   ((size_t)1 << (power - 2));
+}
+
+void arena_init(arena_t *arena)
+{
+	for (unsigned int i = 0; i < ARENA_CLASSES; i++)
+		slab_pool_init(&arena->classes[i], arena_class_size(i));
+	arena->large = NULL;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+	if (size <= ARENA_MAX_CLASS)
+		return slab_alloc(&arena->classes[arena_class(size)]);
+
+	arena_block *block = malloc(sizeof(arena_block) + size);
+	DIE(!block, "malloc failed");
+	block->prev = NULL;
+	block->next = arena->large;
+	if (arena->large)
+		arena->large->prev = block;
+	arena->large = block;
+	return block + 1;
+}
+
+void arena_free(arena_t *arena, void *block, size_t size)
+{
+	if (!block)
+		return;
+
+	if (size <= ARENA_MAX_CLASS)
+	{
+		slab_free(&arena->classes[arena_class(size)], block);
+		return;
+	}
+
+	arena_block *large = (arena_block *)block - 1;
+	if (large->prev)
+		large->prev->next = large->next;
+	else
+		arena->large = large->next;
+	if (large->next)
+		large->next->prev = large->prev;
+	free(large);
+}
+
+char *arena_strdup(arena_t *arena, const char *string)
+{
+	size_t size = strlen(string) + 1;
+	char *copy = arena_alloc(arena, size);
+	memcpy(copy, string, size);
+	return copy;
+}
+
+void arena_free_string(arena_t *arena, char *string)
+{
+	if (string)
+		arena_free(arena, string, strlen(string) + 1);
+}
+
+void arena_release(arena_t *arena)
+{
+	for (unsigned int i = 0; i < ARENA_CLASSES; i++)
+		slab_pool_release(&arena->classes[i]);
+
+	arena_block *block = arena->large;
+	while (block)
+	{
+		arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->large = NULL;
+}
+
+void arena_adopt(arena_t *arena, arena_t *other)
+{
+	for (unsigned int i = 0; i < ARENA_CLASSES; i++)
+		slab_pool_adopt(&arena->classes[i], &other->classes[i]);
+
+	if (other->large)
+	{
+		arena_block *last = other->large;
+		while (last->next)
+			last = last->next;
+		last->next = arena->large;
+		if (arena->large)
+			arena->large->prev = last;
+		arena->large = other->large;
+		other->large = NULL;
+	}
+}
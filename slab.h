@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/**
+ * Pool of fixed size objects, carved out of large chunks. Freed objects are
+ * kept on a free list and handed out again before a new chunk is allocated,
+ * and all the objects of a pool are released at once with its chunks.
+ */
+#define SLAB_CHUNK_SIZE     16384
+#define SLAB_ALIGN          8
+
+typedef struct slab_chunk slab_chunk;
+
+typedef struct slab_pool_t {
+    void *free_list;
+    slab_chunk *chunks;
+    char *next_object;
+    char *chunk_end;
+    unsigned int object_size;
+    unsigned int objects;
+} slab_pool_t;
+
+void slab_pool_init(slab_pool_t *pool, unsigned int object_size);
+
+void *slab_alloc(slab_pool_t *pool);
+
+void slab_free(slab_pool_t *pool, void *object);
+
+/**
+ * slab_pool_release() - Frees every chunk of the pool, and with them all
+ * its objects, whether they were freed or not. The pool stays usable.
+ */
+void slab_pool_release(slab_pool_t *pool);
+
+/**
+ * slab_pool_adopt() - Moves the chunks of another pool of the same object
+ * size into this one, which releases them from then on. The objects in use
+ * stay valid and may be freed to either pool; the other pool is left empty.
+ */
+void slab_pool_adopt(slab_pool_t *pool, slab_pool_t *other);
+
+/**
+ * Byte arena serving variable sized blocks from slab pools of size classes.
+ * Classes grow by a quarter of a power of two, so a block wastes less than
+ * a quarter of its size. Blocks larger than ARENA_MAX_CLASS are allocated
+ * one by one, but are still released with the arena.
+ */
+#define ARENA_MAX_CLASS     8192
+#define ARENA_CLASSES       32
+
+typedef struct arena_block arena_block;
+
+typedef struct arena_t {
+    slab_pool_t classes[ARENA_CLASSES];
+    arena_block *large;
+} arena_t;
+
+void arena_init(arena_t *arena);
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * arena_free() - Gives a block back to the arena.
+ *
+ * @param size: The size the block was allocated with.
+ */
+void arena_free(arena_t *arena, void *block, size_t size);
+
+char *arena_strdup(arena_t *arena, const char *string);
+
+/**
+ * arena_free_string() - Gives back a string allocated by arena_strdup().
+ */
+void arena_free_string(arena_t *arena, char *string);
+
+/**
+ * arena_release() - Frees every block of the arena at once. The arena
+ * stays usable.
+ */
+void arena_release(arena_t *arena);
+
+/**
+ * arena_adopt() - Moves every block of another arena into this one, with
+ * slab_pool_adopt() for the size classes. The other arena is left empty.
+ */
+void arena_adopt(arena_t *arena, arena_t *other);
+
+#endif /* SLAB_H */
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <stdbool.h>
+#include <time.h>
+#include "stats.h"
+
+/**
+ * hdr_index() - Bucket of a value: its top HDR_SUB_BITS + 1 bits select the
+ * bucket inside the range of its most significant bit.
+ */
+static unsigned int hdr_index(unsigned long long value)
+{
+	if (value < HDR_SUB_BUCKETS)
+		return value;
+
+	if (value >> HDR_MAX_BITS)
+		value = (1ull << HDR_MAX_BITS) - 1;
+
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int shift = msb - HDR_SUB_BITS;
+	return (shift + 1) * HDR_SUB_BUCKETS +
+		   ((value >> shift) & (HDR_SUB_BUCKETS - 1));
+}
+
+/**
+ * hdr_highest_value() - Highest value counted in a bucket.
+ */
+static unsigned long long hdr_highest_value(unsigned int index)
+{
+	if (index < HDR_SUB_BUCKETS)
+		return index;
+
+	unsigned int shift = index / HDR_SUB_BUCKETS - 1;
+	unsigned long long sub = HDR_SUB_BUCKETS + index % HDR_SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * The servers may record from their worker threads, so the histograms and
+ * the global counters are updated with relaxed atomic operations.
+ */
+void hdr_record(hdr_histogram *histogram, unsigned long long value)
+{
+	__atomic_add_fetch(&histogram->counts[hdr_index(value)], 1,
+					   __ATOMIC_RELAXED);
+	__atomic_add_fetch(&histogram->total, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&histogram->sum, value, __ATOMIC_RELAXED);
+
+	unsigned long long max = __atomic_load_n(&histogram->max,
+											 __ATOMIC_RELAXED);
+	while (value > max &&
+		   !__atomic_compare_exchange_n(&histogram->max, &max, value, true,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+unsigned long long hdr_percentile(const hdr_histogram *histogram, double p)
+{
+	if (!histogram->total)
+		return 0;
+
+	unsigned long long rank = (unsigned long long)(p * histogram->total);
+	if (rank < 1)
+		rank = 1;
+
+	unsigned long long seen = 0;
+	for (unsigned int i = 0; i < HDR_BUCKETS; i++)
+	{
+		seen += histogram->counts[i];
+		if (seen >= rank)
+		{
+			unsigned long long value = hdr_highest_value(i);
+			return value < histogram->max ? value : histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+#ifndef DISABLE_STATS
+
+static hdr_histogram latencies[STATS_LATENCIES];
+static stats_counters global_counters;
+
+static const char *latency_names[STATS_LATENCIES] = {
+	"route", "get", "edit", "drain", "add_server", "remove_server"
+};
+
+static const char *counter_names[STATS_COUNTERS] = {
+	"gets", "edits", "drains", "tasks", "cache_hits", "cache_misses",
+	"cache_evictions", "documents_migrated", "bytes_migrated"
+};
+
+unsigned long long stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void stats_record(stats_latency latency, unsigned long long nanoseconds)
+{
+	hdr_record(&latencies[latency], nanoseconds);
+}
+
+void stats_count(stats_counters counters, stats_counter counter,
+				 unsigned long long value)
+{
+	// the counters of a server are only updated by the thread serving it
+	counters[counter] += value;
+	__atomic_add_fetch(&global_counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void stats_print_counters(output_sink *out, const stats_counters counters)
+{
+	for (unsigned int i = 0; i < STATS_COUNTERS; i++)
+		output_printf(out, " %s=%llu", counter_names[i], counters[i]);
+}
+
+void stats_print_global(output_sink *out)
+{
+	output_puts(out, "[Stats]");
+	stats_print_counters(out, global_counters);
+	output_puts(out, "\n");
+
+	for (unsigned int i = 0; i < STATS_LATENCIES; i++)
+	{
+		hdr_histogram *histogram = &latencies[i];
+		output_printf(out, "[Stats] %s_ns count=%llu mean=%llu p50=%llu "
+					  "p90=%llu p99=%llu p999=%llu max=%llu\n",
+					  latency_names[i], histogram->total,
+					  histogram->total ? histogram->sum / histogram->total : 0,
+					  hdr_percentile(histogram, 0.50),
+					  hdr_percentile(histogram, 0.90),
+					  hdr_percentile(histogram, 0.99),
+					  hdr_percentile(histogram, 0.999),
+					  histogram->max);
+	}
+}
+
+#endif /* DISABLE_STATS */
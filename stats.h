@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "output.h"
+
+/**
+ * Latency histogram in the HDR style: values below HDR_SUB_BUCKETS have a
+ * bucket each, and every larger power of two range is split in
+ * HDR_SUB_BUCKETS buckets, so a recorded value is known within 1/16 of
+ * itself. Values of HDR_MAX_BITS bits or more are counted in the last
+ * bucket, but the maximum is kept exactly.
+ */
+#define HDR_SUB_BITS        4
+#define HDR_SUB_BUCKETS     (1u << HDR_SUB_BITS)
+#define HDR_MAX_BITS        40
+#define HDR_BUCKETS         ((HDR_MAX_BITS - HDR_SUB_BITS + 1) * HDR_SUB_BUCKETS)
+
+typedef struct hdr_histogram {
+    unsigned long long counts[HDR_BUCKETS];
+    unsigned long long total;
+    unsigned long long sum;
+    unsigned long long max;
+} hdr_histogram;
+
+void hdr_record(hdr_histogram *histogram, unsigned long long value);
+
+/**
+ * hdr_percentile() - Gets the highest value equivalent to the one below
+ * which a fraction p of the recorded values fall, or 0 if none was recorded.
+ */
+unsigned long long hdr_percentile(const hdr_histogram *histogram, double p);
+
+/**
+ * Latencies are recorded in nanoseconds, globally. Counters are kept both
+ * per server and globally, so the counts of removed servers stay in the
+ * global ones.
+ */
+typedef enum stats_latency {
+    STATS_ROUTE,
+    STATS_GET,
+    STATS_EDIT,
+    STATS_DRAIN,
+    STATS_ADD_SERVER,
+    STATS_REMOVE_SERVER,
+    STATS_LATENCIES
+} stats_latency;
+
+typedef enum stats_counter {
+    STATS_GETS,
+    STATS_EDITS,
+    STATS_DRAINS,
+    STATS_TASKS,
+    STATS_CACHE_HITS,
+    STATS_CACHE_MISSES,
+    STATS_CACHE_EVICTIONS,
+    STATS_DOCUMENTS_MIGRATED,
+    STATS_BYTES_MIGRATED,
+    STATS_COUNTERS
+} stats_counter;
+
+typedef unsigned long long stats_counters[STATS_COUNTERS];
+
+/**
+ * The instrumentation is compiled out with -DDISABLE_STATS (make STATS=0):
+ * the macros expand to nothing, so their arguments, the counters of the
+ * servers included, do not need to exist. A STATS request prints nothing.
+ */
+#ifndef DISABLE_STATS
+
+unsigned long long stats_now(void);
+
+void stats_record(stats_latency latency, unsigned long long nanoseconds);
+
+/**
+ * stats_count() - Adds to a counter of a server and to the global one.
+ */
+void stats_count(stats_counters counters, stats_counter counter,
+                 unsigned long long value);
+
+void stats_print_global(output_sink *out);
+
+void stats_print_counters(output_sink *out, const stats_counters counters);
+
+#define STATS_TIMER(name)           unsigned long long name = stats_now()
+#define STATS_RECORD(latency, start) \
+    stats_record(latency, stats_now() - (start))
+#define STATS_COUNT(counters, counter, value) \
+    stats_count(counters, counter, value)
+
+#else
+
+#define STATS_TIMER(name)
+#define STATS_RECORD(latency, start)            ((void)0)
+#define STATS_COUNT(counters, counter, value)   ((void)0)
+
+#endif /* DISABLE_STATS */
+
+#endif /* STATS_H */
@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "swiss_table.h"
+#include "utils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SWISS_EMPTY     0x80
+#define SWISS_DELETED   0xFE
+
+/**
+ * Slot header, followed by the value. Keys which do not fit inline are
+ * copied on the heap.
+ */
+typedef struct swiss_slot {
+	unsigned int hash;
+	unsigned int key_size;
+	union {
+		char inline_key[SWISS_INLINE_KEY];
+		char *heap_key;
+	} key;
+} swiss_slot;
+
+#define SWISS_VALUE_ALIGN   8
+
+/**
+ * swiss_mix() - Spreads the user hash over all the bits, since the control
+ * byte uses the low bits and the position the high ones.
+ */
+static unsigned int swiss_mix(unsigned int hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bu;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static unsigned char swiss_h2(unsigned int hash)
+{
+	return hash & 0x7F;
+}
+
+static swiss_slot *swiss_slot_in(swiss_table_t *table, char *slots,
+								 unsigned int index)
+{
+	return (swiss_slot *)(slots + (size_t)index * table->slot_size);
+}
+
+static swiss_slot *swiss_slot_at(swiss_table_t *table, unsigned int index)
+{
+	return swiss_slot_in(table, table->slots, index);
+}
+
+static void *swiss_slot_key(swiss_slot *slot)
+{
+	if (slot->key_size <= SWISS_INLINE_KEY)
+		return slot->key.inline_key;
+	return slot->key.heap_key;
+}
+
+static void *swiss_slot_value(swiss_slot *slot)
+{
+	return (char *)slot + sizeof(swiss_slot);
+}
+
+/**
+ * swiss_group_match() - Bitmask of the control bytes of a group which are
+ * equal to a given byte.
+ */
+static unsigned int swiss_group_match(const unsigned char *group,
+									  unsigned char byte)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	__m128i match = _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte));
+	return (unsigned int)_mm_movemask_epi8(match);
+#else
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < SWISS_GROUP_WIDTH; i++)
+		if (group[i] == byte)
+			mask |= 1u << i;
+	return mask;
+#endif
+}
+
+/**
+ * swiss_set_ctrl_in() - Writes a control byte, mirroring the first group
+ * after the end of the array so a group load never has to wrap around.
+ */
+static void swiss_set_ctrl_in(unsigned char *ctrl, unsigned int capacity,
+							  unsigned int index, unsigned char byte)
+{
+	ctrl[index] = byte;
+	if (index < SWISS_GROUP_WIDTH)
+		ctrl[capacity + index] = byte;
+}
+
+static void swiss_set_ctrl(swiss_table_t *table, unsigned int index,
+						   unsigned char byte)
+{
+	swiss_set_ctrl_in(table->ctrl, table->capacity, index, byte);
+}
+
+static void swiss_alloc(swiss_table_t *table, unsigned int capacity)
+{
+	table->capacity = capacity;
+	table->ctrl = malloc(capacity + SWISS_GROUP_WIDTH);
+	DIE(!table->ctrl, "malloc failed");
+	memset(table->ctrl, SWISS_EMPTY, capacity + SWISS_GROUP_WIDTH);
+	table->slots = malloc((size_t)capacity * table->slot_size);
+	DIE(!table->slots, "malloc failed");
+	table->size = 0;
+	table->tombstones = 0;
+}
+
+swiss_table_t *swiss_create(unsigned int capacity, unsigned int value_size,
+							unsigned int (*hash_function)(void *),
+							int (*compare_function)(void *, void *))
+{
+	swiss_table_t *table = malloc(sizeof(swiss_table_t));
+	DIE(!table, "malloc failed");
+
+	table->value_size = value_size;
+	table->slot_size = sizeof(swiss_slot) + value_size;
+	table->slot_size = (table->slot_size + SWISS_VALUE_ALIGN - 1) &
+					   ~(SWISS_VALUE_ALIGN - 1);
+	table->hash_function = hash_function;
+	table->compare_function = compare_function;
+	table->old_ctrl = NULL;
+	table->old_slots = NULL;
+	table->old_capacity = 0;
+	table->old_size = 0;
+	table->migrated = 0;
+
+	// keep the load factor under 7/8 for the expected number of keys
+	unsigned int slots = SWISS_MIN_CAPACITY;
+	while (slots / 8 * 7 < capacity)
+		slots <<= 1;
+	swiss_alloc(table, slots);
+	return table;
+}
+
+/**
+ * swiss_find_in() - Probes the groups of a hash in a pair of arrays until
+ * the key or an empty control byte is found.
+ *
+ * @return - Index of the key's slot, or -1 if the key is not found.
+ */
+static long swiss_find_in(swiss_table_t *table, const unsigned char *ctrl,
+						  char *slots, unsigned int capacity, void *key,
+						  unsigned int hash)
+{
+	unsigned int mask = capacity - 1;
+	unsigned int position = (hash >> 7) & mask;
+	unsigned char h2 = swiss_h2(hash);
+
+	for (unsigned int stride = 0; stride <= capacity;
+		 stride += SWISS_GROUP_WIDTH)
+	{
+		const unsigned char *group = ctrl + position;
+		unsigned int match = swiss_group_match(group, h2);
+		while (match)
+		{
+			unsigned int index = (position + __builtin_ctz(match)) & mask;
+			swiss_slot *slot = swiss_slot_in(table, slots, index);
+			if (slot->hash == hash &&
+				table->compare_function(swiss_slot_key(slot), key) == 0)
+				return index;
+			match &= match - 1;
+		}
+
+		if (swiss_group_match(group, SWISS_EMPTY))
+			return -1;
+
+		// triangular probing visits every group once
+		position = (position + stride + SWISS_GROUP_WIDTH) & mask;
+	}
+	return -1;
+}
+
+static long swiss_find(swiss_table_t *table, void *key, unsigned int hash)
+{
+	return swiss_find_in(table, table->ctrl, table->slots, table->capacity,
+						 key, hash);
+}
+
+/**
+ * swiss_find_old() - Looks a key up in the old arrays of a growing table.
+ * The slots already moved are left deleted, so probes still pass over them
+ * without reading their keys, which may be freed by then.
+ */
+static long swiss_find_old(swiss_table_t *table, void *key, unsigned int hash)
+{
+	if (!table->old_ctrl)
+		return -1;
+
+	return swiss_find_in(table, table->old_ctrl, table->old_slots,
+						 table->old_capacity, key, hash);
+}
+
+/**
+ * swiss_find_free() - First empty or deleted slot on the probe sequence.
+ */
+static unsigned int swiss_find_free(swiss_table_t *table, unsigned int hash)
+{
+	unsigned int mask = table->capacity - 1;
+	unsigned int position = (hash >> 7) & mask;
+
+	for (unsigned int stride = 0;; stride += SWISS_GROUP_WIDTH)
+	{
+		const unsigned char *group = table->ctrl + position;
+		unsigned int free_slots = swiss_group_match(group, SWISS_EMPTY) |
+								  swiss_group_match(group, SWISS_DELETED);
+		if (free_slots)
+			return (position + __builtin_ctz(free_slots)) & mask;
+
+		position = (position + stride + SWISS_GROUP_WIDTH) & mask;
+	}
+}
+
+/**
+ * swiss_migrate() - Moves some groups of old slots in the current arrays,
+ * freeing the old arrays after the last one. Heap keys are moved, not
+ * copied.
+ */
+static void swiss_migrate(swiss_table_t *table, unsigned int groups)
+{
+	if (!table->old_ctrl)
+		return;
+
+	unsigned int end = table->old_capacity;
+	if ((end - table->migrated) / SWISS_GROUP_WIDTH > groups)
+		end = table->migrated + groups * SWISS_GROUP_WIDTH;
+
+	for (; table->migrated < end; table->migrated++)
+	{
+		if (table->old_ctrl[table->migrated] & 0x80)
+			continue;
+
+		swiss_slot *old_slot =
+			swiss_slot_in(table, table->old_slots, table->migrated);
+		unsigned int index = swiss_find_free(table, old_slot->hash);
+		if (table->ctrl[index] == SWISS_DELETED)
+			table->tombstones--;
+		swiss_set_ctrl(table, index, swiss_h2(old_slot->hash));
+		memcpy(swiss_slot_at(table, index), old_slot, table->slot_size);
+		swiss_set_ctrl_in(table->old_ctrl, table->old_capacity,
+						  table->migrated, SWISS_DELETED);
+		table->old_size--;
+	}
+
+	if (table->migrated == table->old_capacity)
+	{
+		free(table->old_ctrl);
+		free(table->old_slots);
+		table->old_ctrl = NULL;
+		table->old_slots = NULL;
+		table->old_capacity = 0;
+	}
+}
+
+/**
+ * swiss_resize() - Swaps in empty arrays of a capacity, dropping the
+ * tombstones, and starts moving the slots of the current ones in them.
+ */
+static void swiss_resize(swiss_table_t *table, unsigned int capacity)
+{
+	swiss_migrate(table, UINT_MAX);
+
+	table->old_ctrl = table->ctrl;
+	table->old_slots = table->slots;
+	table->old_capacity = table->capacity;
+	table->old_size = table->size;
+	table->migrated = 0;
+
+	unsigned int size = table->size;
+	swiss_alloc(table, capacity);
+	table->size = size;
+}
+
+void *swiss_emplace(swiss_table_t *table, void *key, unsigned int key_size,
+					bool *inserted)
+{
+	return swiss_emplace_hashed(table, key, key_size,
+								table->hash_function(key), inserted);
+}
+
+void *swiss_emplace_hashed(swiss_table_t *table, void *key,
+						   unsigned int key_size, unsigned int hash,
+						   bool *inserted)
+{
+	swiss_migrate(table, SWISS_MIGRATE_STEP);
+	hash = swiss_mix(hash);
+	long found = swiss_find(table, key, hash);
+	if (found >= 0)
+	{
+		if (inserted)
+			*inserted = false;
+		return swiss_slot_value(swiss_slot_at(table, found));
+	}
+
+	found = swiss_find_old(table, key, hash);
+	if (found >= 0)
+	{
+		if (inserted)
+			*inserted = false;
+		return swiss_slot_value(swiss_slot_in(table, table->old_slots, found));
+	}
+
+	unsigned int current = table->size - table->old_size;
+	if ((current + table->tombstones + 1) * 8 > table->capacity * 7)
+	{
+		// mostly tombstones: clean them instead of growing
+		if (table->size * 2 < table->capacity / 8 * 7)
+			swiss_resize(table, table->capacity);
+		else
+			swiss_resize(table, table->capacity * 2);
+	}
+
+	unsigned int index = swiss_find_free(table, hash);
+	if (table->ctrl[index] == SWISS_DELETED)
+		table->tombstones--;
+	swiss_set_ctrl(table, index, swiss_h2(hash));
+
+	swiss_slot *slot = swiss_slot_at(table, index);
+	slot->hash = hash;
+	slot->key_size = key_size;
+	if (key_size <= SWISS_INLINE_KEY)
+	{
+		memcpy(slot->key.inline_key, key, key_size);
+	}
+	else
+	{
+		slot->key.heap_key = malloc(key_size);
+		DIE(!slot->key.heap_key, "malloc failed");
+		memcpy(slot->key.heap_key, key, key_size);
+	}
+	memset(swiss_slot_value(slot), 0, table->value_size);
+	table->size++;
+
+	if (inserted)
+		*inserted = true;
+	return swiss_slot_value(slot);
+}
+
+int swiss_put(swiss_table_t *table, void *key, unsigned int key_size,
+			  void *value, unsigned int value_size)
+{
+	DIE(value_size > table->value_size, "value too large for table");
+
+	bool inserted;
+	void *slot_value = swiss_emplace(table, key, key_size, &inserted);
+	memcpy(slot_value, value, value_size);
+	return !inserted;
+}
+
+void *swiss_get(swiss_table_t *table, void *key)
+{
+	return swiss_get_hashed(table, key, table->hash_function(key));
+}
+
+void *swiss_get_hashed(swiss_table_t *table, void *key, unsigned int hash)
+{
+	hash = swiss_mix(hash);
+	long found = swiss_find(table, key, hash);
+	if (found >= 0)
+		return swiss_slot_value(swiss_slot_at(table, found));
+
+	found = swiss_find_old(table, key, hash);
+	if (found >= 0)
+		return swiss_slot_value(swiss_slot_in(table, table->old_slots, found));
+	return NULL;
+}
+
+int swiss_remove(swiss_table_t *table, void *key)
+{
+	return swiss_remove_hashed(table, key, table->hash_function(key));
+}
+
+/**
+ * swiss_remove_old() - Removes a key not moved yet from the old arrays,
+ * which only ever lose slots, so a tombstone is enough.
+ */
+static int swiss_remove_old(swiss_table_t *table, void *key, unsigned int hash)
+{
+	long found = swiss_find_old(table, key, hash);
+	if (found < 0)
+		return 0;
+
+	swiss_slot *slot = swiss_slot_in(table, table->old_slots, found);
+	if (slot->key_size > SWISS_INLINE_KEY)
+		free(slot->key.heap_key);
+	swiss_set_ctrl_in(table->old_ctrl, table->old_capacity, found,
+					  SWISS_DELETED);
+	table->old_size--;
+	table->size--;
+	return 1;
+}
+
+int swiss_remove_hashed(swiss_table_t *table, void *key, unsigned int hash)
+{
+	swiss_migrate(table, SWISS_MIGRATE_STEP);
+	hash = swiss_mix(hash);
+	long found = swiss_find(table, key, hash);
+	if (found < 0)
+		return swiss_remove_old(table, key, hash);
+
+	swiss_slot *slot = swiss_slot_at(table, found);
+	if (slot->key_size > SWISS_INLINE_KEY)
+		free(slot->key.heap_key);
+
+	/**
+	 * The slot can become empty again only if no probe ever passed over it,
+	 * which holds when its group never filled up.
+	 */
+	unsigned int mask = table->capacity - 1;
+	unsigned int before = (found - SWISS_GROUP_WIDTH) & mask;
+	unsigned int empty_after =
+		swiss_group_match(table->ctrl + found, SWISS_EMPTY);
+	unsigned int empty_before =
+		swiss_group_match(table->ctrl + before, SWISS_EMPTY);
+	if (empty_after && empty_before &&
+		__builtin_ctz(empty_after) + __builtin_clz(empty_before << 16) <
+		SWISS_GROUP_WIDTH)
+	{
+		swiss_set_ctrl(table, found, SWISS_EMPTY);
+	}
+	else
+	{
+		swiss_set_ctrl(table, found, SWISS_DELETED);
+		table->tombstones++;
+	}
+
+	table->size--;
+	return 1;
+}
+
+void swiss_for_each(swiss_table_t *table,
+					void (*function)(void *key, void *value, void *arg),
+					void *arg)
+{
+	for (unsigned int i = 0; i < table->capacity; i++)
+	{
+		if (table->ctrl[i] & 0x80)
+			continue;
+
+		swiss_slot *slot = swiss_slot_at(table, i);
+		function(swiss_slot_key(slot), swiss_slot_value(slot), arg);
+	}
+
+	for (unsigned int i = table->migrated; i < table->old_capacity; i++)
+	{
+		if (table->old_ctrl[i] & 0x80)
+			continue;
+
+		swiss_slot *slot = swiss_slot_in(table, table->old_slots, i);
+		function(swiss_slot_key(slot), swiss_slot_value(slot), arg);
+	}
+}
+
+void swiss_reserve(swiss_table_t *table, unsigned int keys)
+{
+	unsigned int slots = table->capacity;
+	while (slots / 8 * 7 < table->size + keys)
+		slots <<= 1;
+	if (slots != table->capacity)
+		swiss_resize(table, slots);
+}
+
+/**
+ * swiss_free_keys() - Frees the heap keys of the slots of a pair of arrays,
+ * from a given index on.
+ */
+static void swiss_free_keys(swiss_table_t *table, const unsigned char *ctrl,
+							char *slots, unsigned int from,
+							unsigned int capacity)
+{
+	for (unsigned int i = from; i < capacity; i++)
+	{
+		if (ctrl[i] & 0x80)
+			continue;
+
+		swiss_slot *slot = swiss_slot_in(table, slots, i);
+		if (slot->key_size > SWISS_INLINE_KEY)
+			free(slot->key.heap_key);
+	}
+}
+
+void swiss_free(swiss_table_t *table)
+{
+	swiss_free_keys(table, table->ctrl, table->slots, 0, table->capacity);
+	if (table->old_ctrl)
+		swiss_free_keys(table, table->old_ctrl, table->old_slots,
+						table->migrated, table->old_capacity);
+
+	free(table->old_ctrl);
+	free(table->old_slots);
+	free(table->ctrl);
+	free(table->slots);
+	free(table);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef SWISS_TABLE_H
+#define SWISS_TABLE_H
+
+#include <stdbool.h>
+
+/**
+ * Open addressing hash table in the Swiss table style. Every slot has a
+ * control byte holding 7 bits of its hash, and a probe compares a whole
+ * group of control bytes at once, so keys are only compared on a probable
+ * match. Slots live in one slab: each one stores the hash, the key (inline
+ * when it is short) and a fixed size value.
+ */
+#define SWISS_GROUP_WIDTH   16
+#define SWISS_INLINE_KEY    32
+#define SWISS_MIN_CAPACITY  SWISS_GROUP_WIDTH
+
+/**
+ * A growing table allocates the new arrays and keeps the old ones, moving
+ * SWISS_MIGRATE_STEP groups of old slots on every insertion and removal, so
+ * no single operation pays for the whole rehash. Lookups check the old
+ * arrays too until they are empty.
+ */
+#ifndef SWISS_MIGRATE_STEP
+#define SWISS_MIGRATE_STEP  2
+#endif
+
+typedef struct swiss_table_t swiss_table_t;
+struct swiss_table_t {
+    unsigned char *ctrl;
+    char *slots;
+    unsigned int capacity;
+    // keys in both arrays
+    unsigned int size;
+    unsigned int tombstones;
+    // arrays being moved in the current ones, NULL when not growing
+    unsigned char *old_ctrl;
+    char *old_slots;
+    unsigned int old_capacity;
+    unsigned int old_size;
+    // old slots before this one were moved
+    unsigned int migrated;
+    unsigned int slot_size;
+    unsigned int value_size;
+    unsigned int (*hash_function)(void*);
+    int (*compare_function)(void*, void*);
+};
+
+/**
+ * swiss_create() - Creates an empty table.
+ *
+ * @param capacity: Expected number of keys; the table grows past it.
+ * @param value_size: Size of every value stored in the table.
+ */
+swiss_table_t *swiss_create(unsigned int capacity, unsigned int value_size,
+                            unsigned int (*hash_function)(void*),
+                            int (*compare_function)(void*, void*));
+
+/**
+ * swiss_get() - Finds the value of a key.
+ *
+ * @return - Pointer to the value inside the table, valid until the next
+ *      insertion or removal, or NULL if the key is not found.
+ */
+void *swiss_get(swiss_table_t *table, void *key);
+
+/**
+ * swiss_emplace() - Finds the value of a key, inserting the key with a
+ * zeroed value if it is missing, with a single probe.
+ *
+ * @param inserted: Set to true if the key was inserted. May be NULL.
+ *
+ * @return - Pointer to the value inside the table, valid until the next
+ *      insertion or removal.
+ */
+void *swiss_emplace(swiss_table_t *table, void *key, unsigned int key_size,
+                    bool *inserted);
+
+/**
+ * swiss_put() - Copies a key-value pair in the table, replacing the value
+ * if the key exists.
+ *
+ * @return - 1 if the key existed, 0 otherwise.
+ */
+int swiss_put(swiss_table_t *table, void *key, unsigned int key_size,
+              void *value, unsigned int value_size);
+
+/**
+ * swiss_remove() - Removes a key and frees its copies.
+ *
+ * @return - 1 if the key existed, 0 otherwise.
+ */
+int swiss_remove(swiss_table_t *table, void *key);
+
+/**
+ * The *_hashed() variants take the hash of the key, precomputed with the
+ * table's hash function.
+ */
+void *swiss_get_hashed(swiss_table_t *table, void *key, unsigned int hash);
+
+void *swiss_emplace_hashed(swiss_table_t *table, void *key,
+                           unsigned int key_size, unsigned int hash,
+                           bool *inserted);
+
+int swiss_remove_hashed(swiss_table_t *table, void *key, unsigned int hash);
+
+/**
+ * swiss_for_each() - Calls a function for every key-value pair, in slot
+ * order. The table must not be modified meanwhile.
+ */
+void swiss_for_each(swiss_table_t *table,
+                    void (*function)(void *key, void *value, void *arg),
+                    void *arg);
+
+/**
+ * swiss_reserve() - Grows the table once so that it takes more keys without
+ * growing again, instead of doubling it several times meanwhile. The slots
+ * still move a few groups at a time.
+ *
+ * @param keys: Number of keys about to be inserted.
+ */
+void swiss_reserve(swiss_table_t *table, unsigned int keys);
+
+void swiss_free(swiss_table_t *table);
+
+#endif /* SWISS_TABLE_H */
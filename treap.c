@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include "treap.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The priorities only have to look random, so they are derived from the
+ * node address instead of a shared generator.
+ */
+static unsigned int treap_priority(treap_node_t *node)
+{
+	uint64_t bits = (uint64_t)(uintptr_t)node;
+
+	bits ^= bits >> 33;
+	bits *= 0xff51afd7ed558ccdULL;
+	bits ^= bits >> 33;
+
+	return (unsigned int)bits;
+}
+
+treap_t *treap_create(unsigned int data_size, unsigned int origin)
+{
+	return treap_create_pooled(data_size, origin, NULL);
+}
+
+treap_t *treap_create_pooled(unsigned int data_size, unsigned int origin,
+							 slab_pool_t *pool)
+{
+	treap_t *treap = malloc(sizeof(treap_t));
+	treap->root = NULL;
+	treap->data_size = data_size;
+	treap->size = 0;
+	treap->origin = origin;
+	treap->pool = pool;
+	return treap;
+}
+
+#define TREAP_NODE_SIZE \
+	((sizeof(treap_node_t) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+
+static treap_node_t *treap_node_alloc(treap_t *treap)
+{
+	treap_node_t *node;
+
+	if (treap->pool)
+		node = slab_alloc(treap->pool);
+	else
+		node = malloc(TREAP_NODE_SIZE + treap->data_size);
+	node->data = (char *)node + TREAP_NODE_SIZE;
+	return node;
+}
+
+void treap_node_free(treap_t *treap, treap_node_t *node)
+{
+	if (treap->pool)
+		slab_free(treap->pool, node);
+	else
+		free(node);
+}
+
+unsigned int treap_get_size(treap_t *treap)
+{
+	return treap->size;
+}
+
+unsigned int treap_distance(treap_t *treap, unsigned int key)
+{
+	return treap->origin - key;
+}
+
+static unsigned int treap_node_count(treap_node_t *node)
+{
+	return node ? node->count : 0;
+}
+
+static void treap_update_count(treap_node_t *node)
+{
+	node->count = 1 + treap_node_count(node->left) +
+				  treap_node_count(node->right);
+}
+
+static void treap_rotate_up(treap_t *treap, treap_node_t *node)
+{
+	treap_node_t *parent = node->parent;
+	treap_node_t *grandparent = parent->parent;
+
+	if (parent->left == node)
+	{
+		parent->left = node->right;
+		if (node->right)
+			node->right->parent = parent;
+		node->right = parent;
+	}
+	else
+	{
+		parent->right = node->left;
+		if (node->left)
+			node->left->parent = parent;
+		node->left = parent;
+	}
+
+	parent->parent = node;
+	node->parent = grandparent;
+	// the pair keeps its subtree, the parent is now below the node
+	treap_update_count(parent);
+	treap_update_count(node);
+
+	if (!grandparent)
+		treap->root = node;
+	else if (grandparent->left == parent)
+		grandparent->left = node;
+	else
+		grandparent->right = node;
+}
+
+treap_node_t *treap_insert(treap_t *treap, unsigned int key,
+						   const void *new_data)
+{
+	treap_node_t *node = treap_node_alloc(treap);
+	memcpy(node->data, new_data, treap->data_size);
+	node->key = key;
+	node->priority = treap_priority(node);
+	node->count = 1;
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = NULL;
+	treap_insert_node(treap, node);
+	return node;
+}
+
+void treap_insert_node(treap_t *treap, treap_node_t *node)
+{
+	unsigned int distance = treap_distance(treap, node->key);
+	treap_node_t *parent = NULL;
+	treap_node_t *current = treap->root;
+	while (current)
+	{
+		parent = current;
+		current->count++;
+		if (distance < treap_distance(treap, current->key))
+			current = current->left;
+		else
+			current = current->right;
+	}
+
+	node->parent = parent;
+	if (!parent)
+		treap->root = node;
+	else if (distance < treap_distance(treap, parent->key))
+		parent->left = node;
+	else
+		parent->right = node;
+
+	while (node->parent && node->parent->priority < node->priority)
+		treap_rotate_up(treap, node);
+
+	treap->size++;
+}
+
+void treap_remove_node(treap_t *treap, treap_node_t *node)
+{
+	// rotate the node down until it has at most one child
+	while (node->left && node->right)
+	{
+		if (node->left->priority > node->right->priority)
+			treap_rotate_up(treap, node->left);
+		else
+			treap_rotate_up(treap, node->right);
+	}
+
+	treap_node_t *child = node->left ? node->left : node->right;
+	if (child)
+		child->parent = node->parent;
+	for (treap_node_t *ancestor = node->parent; ancestor;
+		 ancestor = ancestor->parent)
+		ancestor->count--;
+
+	if (!node->parent)
+		treap->root = child;
+	else if (node->parent->left == node)
+		node->parent->left = child;
+	else
+		node->parent->right = child;
+
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = NULL;
+	node->count = 1;
+	treap->size--;
+}
+
+static void treap_split_nodes(treap_t *treap, treap_node_t *node,
+							  unsigned int threshold,
+							  treap_node_t **near, treap_node_t **far)
+{
+	if (!node)
+	{
+		*near = NULL;
+		*far = NULL;
+		return;
+	}
+
+	if (treap_distance(treap, node->key) > threshold)
+	{
+		treap_split_nodes(treap, node->left, threshold, near, &node->left);
+		if (node->left)
+			node->left->parent = node;
+		treap_update_count(node);
+		*far = node;
+	}
+	else
+	{
+		treap_split_nodes(treap, node->right, threshold, &node->right, far);
+		if (node->right)
+			node->right->parent = node;
+		treap_update_count(node);
+		*near = node;
+	}
+}
+
+void treap_split_far(treap_t *treap, unsigned int threshold, treap_t *far)
+{
+	treap_node_t *near_root = NULL;
+	treap_node_t *far_root = NULL;
+
+	treap_split_nodes(treap, treap->root, threshold, &near_root, &far_root);
+	if (near_root)
+		near_root->parent = NULL;
+	if (far_root)
+		far_root->parent = NULL;
+
+	treap->root = near_root;
+	far->root = far_root;
+	far->size = treap_node_count(far_root);
+	treap->size -= far->size;
+}
+
+static treap_node_t *treap_merge_nodes(treap_node_t *near, treap_node_t *far)
+{
+	if (!near)
+		return far;
+	if (!far)
+		return near;
+
+	if (near->priority > far->priority)
+	{
+		near->right = treap_merge_nodes(near->right, far);
+		near->right->parent = near;
+		treap_update_count(near);
+		return near;
+	}
+
+	far->left = treap_merge_nodes(near, far->left);
+	far->left->parent = far;
+	treap_update_count(far);
+	return far;
+}
+
+void treap_merge_far(treap_t *treap, treap_t *far)
+{
+	treap->root = treap_merge_nodes(treap->root, far->root);
+	if (treap->root)
+		treap->root->parent = NULL;
+	treap->size += far->size;
+
+	far->root = NULL;
+	far->size = 0;
+}
+
+bool treap_contains(treap_t *treap, treap_node_t *node)
+{
+	while (node->parent)
+		node = node->parent;
+	return node == treap->root;
+}
+
+treap_node_t *treap_first(treap_t *treap)
+{
+	treap_node_t *node = treap->root;
+	if (!node)
+		return NULL;
+
+	while (node->left)
+		node = node->left;
+	return node;
+}
+
+treap_node_t *treap_last(treap_t *treap)
+{
+	treap_node_t *node = treap->root;
+	if (!node)
+		return NULL;
+
+	while (node->right)
+		node = node->right;
+	return node;
+}
+
+treap_node_t *treap_next(treap_node_t *node)
+{
+	if (node->right)
+	{
+		node = node->right;
+		while (node->left)
+			node = node->left;
+		return node;
+	}
+
+	while (node->parent && node->parent->right == node)
+		node = node->parent;
+	return node->parent;
+}
+
+treap_node_t *treap_prev(treap_node_t *node)
+{
+	if (node->left)
+	{
+		node = node->left;
+		while (node->right)
+			node = node->right;
+		return node;
+	}
+
+	while (node->parent && node->parent->left == node)
+		node = node->parent;
+	return node->parent;
+}
+
+static void treap_free_nodes(treap_t *treap, treap_node_t *node)
+{
+	if (!node)
+		return;
+
+	treap_free_nodes(treap, node->left);
+	treap_free_nodes(treap, node->right);
+	treap_node_free(treap, node);
+}
+
+void treap_free(treap_t **pp_treap)
+{
+	if (*pp_treap == NULL)
+		return;
+
+	treap_free_nodes(*pp_treap, (*pp_treap)->root);
+	free(*pp_treap);
+	*pp_treap = NULL;
+}
+
+void treap_abandon(treap_t **pp_treap)
+{
+	free(*pp_treap);
+	*pp_treap = NULL;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef TREAP_H
+#define TREAP_H
+
+#include <stdbool.h>
+#include "slab.h"
+
+/**
+ * Randomized search tree whose nodes are ordered by their ring distance to
+ * an origin hash: a node with key k sits at distance (origin - k), computed
+ * modulo 2^32. Storing a replica arc with origin = replica hash keeps the
+ * documents closest to the replica label first and the ones closest to the
+ * previous label last, so a hash range taken over by a new label is always
+ * a suffix of the tree.
+ */
+typedef struct treap_node_t treap_node_t;
+struct treap_node_t
+{
+    void *data;
+    unsigned int key;
+    unsigned int priority;
+    // nodes of the subtree rooted here, so a split knows its sizes
+    unsigned int count;
+    treap_node_t *left, *right, *parent;
+};
+
+typedef struct treap_t treap_t;
+struct treap_t
+{
+    treap_node_t *root;
+    unsigned int data_size;
+    unsigned int size;
+    unsigned int origin;
+    slab_pool_t *pool;
+};
+
+/**
+ * Every node is allocated together with its data, which follows it.
+ */
+treap_t *treap_create(unsigned int data_size, unsigned int origin);
+
+/**
+ * treap_create_pooled() - Creates a treap whose nodes are allocated from a
+ * pool. Treaps exchanging nodes by splits and merges must share the pool.
+ */
+treap_t *treap_create_pooled(unsigned int data_size, unsigned int origin,
+                             slab_pool_t *pool);
+
+unsigned int treap_get_size(treap_t *treap);
+
+/**
+ * treap_distance() - Ring distance from the treap's origin to a key.
+ */
+unsigned int treap_distance(treap_t *treap, unsigned int key);
+
+/**
+ * treap_insert() - Inserts a copy of the data, ordered by the key's distance
+ * to the origin. Equal distances keep their insertion order.
+ *
+ * @return treap_node_t* - The node holding the copied data.
+ */
+treap_node_t *treap_insert(treap_t *treap, unsigned int key,
+                           const void *new_data);
+
+/**
+ * treap_insert_node() - Links, keeping its data, a node unlinked by
+ * treap_remove_node() from a treap sharing the pool of this one.
+ */
+void treap_insert_node(treap_t *treap, treap_node_t *node);
+
+/**
+ * treap_remove_node() - Unlinks a node from the treap. The caller frees the
+ * node with treap_node_free().
+ */
+void treap_remove_node(treap_t *treap, treap_node_t *node);
+
+/**
+ * treap_node_free() - Frees an unlinked node together with its data.
+ */
+void treap_node_free(treap_t *treap, treap_node_t *node);
+
+/**
+ * treap_split_far() - Moves every node whose distance to the origin is
+ * greater than the threshold into another treap, in O(log n) expected time.
+ *
+ * @param treap: Source treap.
+ * @param threshold: Nodes strictly farther than this distance are moved.
+ * @param far: Empty treap which receives the moved nodes. Its origin is
+ *      left unchanged.
+ */
+void treap_split_far(treap_t *treap, unsigned int threshold, treap_t *far);
+
+/**
+ * treap_merge_far() - Appends all the nodes of another treap after the nodes
+ * of this one, leaving the other treap empty. Every node of the appended
+ * treap has to be at least as far from the origin as the existing ones.
+ */
+void treap_merge_far(treap_t *treap, treap_t *far);
+
+/**
+ * treap_contains() - Checks if a node belongs to a treap, by climbing to
+ * the root of its own treap.
+ */
+bool treap_contains(treap_t *treap, treap_node_t *node);
+
+treap_node_t *treap_first(treap_t *treap);
+
+treap_node_t *treap_last(treap_t *treap);
+
+treap_node_t *treap_next(treap_node_t *node);
+
+treap_node_t *treap_prev(treap_node_t *node);
+
+void treap_free(treap_t **pp_treap);
+
+/**
+ * treap_abandon() - Frees a pooled treap without visiting its nodes, which
+ * are released in bulk with their pool.
+ */
+void treap_abandon(treap_t **pp_treap);
+
+#endif /* TREAP_H */
@@ -2,6 +2,7 @@
  * Copyright (c) 2024, <>
  */
 
+#include <stdint.h>
 #include "utils.h"
 
 unsigned int hash_uint(void *key)
@@ -27,6 +28,55 @@ unsigned int hash_string(void *key)
     return hash;
 }
 
+static uint64_t hash_mix64(uint64_t word)
+{
+    word ^= word >> 33;
+    word *= 0xff51afd7ed558ccdULL;
+    word ^= word >> 33;
+    word *= 0xc4ceb9fe1a85ec53ULL;
+    word ^= word >> 33;
+    return word;
+}
+
+unsigned int hash_bytes(const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ (length * 0x87c37b91114253d5ULL);
+    uint64_t word;
+
+    while (length >= sizeof(word))
+    {
+        memcpy(&word, bytes, sizeof(word));
+        hash ^= hash_mix64(word);
+        hash = ((hash << 27) | (hash >> 37)) * 0x4cf5ad432745937fULL;
+        bytes += sizeof(word);
+        length -= sizeof(word);
+    }
+
+    // the last bytes are zero padded; the length is already in the seed
+    word = 0;
+    memcpy(&word, bytes, length);
+    hash ^= hash_mix64(word);
+
+    hash = hash_mix64(hash);
+    return (unsigned int)(hash ^ (hash >> 32));
+}
+
+unsigned int hash_string_fast(void *key)
+{
+    return hash_bytes(key, strlen((char *)key));
+}
+
+doc_key create_doc_key(char *name, unsigned int length,
+                       unsigned int (*hash_function)(void *))
+{
+    doc_key key;
+    key.name = name;
+    key.length = length;
+    key.hash = hash_function(name);
+    return key;
+}
+
 char *get_request_type_str(request_type req_type)
 {
     switch (req_type)
@@ -39,6 +89,8 @@ char *get_request_type_str(request_type req_type)
         return EDIT_REQUEST;
     case GET_DOCUMENT:
         return GET_REQUEST;
+    case GET_STATS:
+        return STATS_REQUEST;
     }
 
     return NULL;
@@ -60,6 +112,9 @@ request_type get_request_type(char *request_type_str)
     else if (!strncmp(request_type_str,
                       GET_REQUEST, strlen(GET_REQUEST)))
         type = GET_DOCUMENT;
+    else if (!strncmp(request_type_str,
+                      STATS_REQUEST, strlen(STATS_REQUEST)))
+        type = GET_STATS;
     else
         DIE(1, "unknown request type");
 
@@ -6,10 +6,12 @@
 #define UTILS_H
 
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "blob.h"
 #include "constants.h"
 
 #define DIE(assertion, call_description)                       \
@@ -22,17 +24,6 @@
         }                                                      \
     } while (0)
 
-#define PRINT_RESPONSE(response_ptr) ({                                \
-    if (response_ptr) {                                                \
-        printf(GENERIC_MSG, response_ptr->server_id,                   \
-               response_ptr->server_response, response_ptr->server_id, \
-               response_ptr->server_log);                              \
-        free(response_ptr->server_response);                           \
-        free(response_ptr->server_log);                                \
-        free(response_ptr);                                            \
-    }                                                                  \
-})
-
 /**
  * @brief Should be used as hash function for server IDs,
  *      to find server's position on the hash ring
@@ -45,6 +36,32 @@ unsigned int hash_uint(void *key);
  */
 unsigned int hash_string(void *key);
 
+/**
+ * hash_bytes() - Hashes a buffer 8 bytes at a time, with a full avalanche
+ * of the result.
+ */
+unsigned int hash_bytes(const void *data, size_t length);
+
+/**
+ * @brief Word-at-a-time alternative to hash_string(), selected for the
+ *      document names by the FAST_DOC_HASH option
+ */
+unsigned int hash_string_fast(void *key);
+
+/**
+ * Key descriptor of a document: its name, the length of the name and the
+ * hash of the name, computed once by the document hash function of the load
+ * balancer and reused by the placement, the server and its tables.
+ */
+typedef struct doc_key {
+    char *name;
+    unsigned int length;
+    unsigned int hash;
+} doc_key;
+
+doc_key create_doc_key(char *name, unsigned int length,
+                       unsigned int (*hash_function)(void *));
+
 char *get_request_type_str(request_type req_type);
 request_type get_request_type(char *request_type_str);
 
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include "worker.h"
+
+void mpsc_init(mpsc_queue *queue)
+{
+	queue->stub.next = NULL;
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+}
+
+void mpsc_push(mpsc_queue *queue, mpsc_node *node)
+{
+	__atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+	mpsc_node *prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+mpsc_node *mpsc_pop(mpsc_queue *queue)
+{
+	mpsc_node *tail = queue->tail;
+	mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &queue->stub)
+	{
+		if (!next)
+			return NULL;
+		queue->tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next)
+	{
+		queue->tail = next;
+		return tail;
+	}
+
+	// the tail is the last linked node: a producer may be pushing after it
+	if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	// the stub is pushed back, so the tail can be handed out
+	mpsc_push(queue, &queue->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next)
+	{
+		queue->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+request_pipeline *pipeline_create(unsigned int capacity)
+{
+	request_pipeline *pipeline = malloc(sizeof(request_pipeline));
+	DIE(!pipeline, "malloc failed");
+
+	pipeline->slots = malloc(capacity * sizeof(request_slot));
+	DIE(!pipeline->slots, "malloc failed");
+	for (unsigned int i = 0; i < capacity; i++)
+		output_memory_init(&pipeline->slots[i].out);
+	pipeline->capacity = capacity;
+	pipeline->posted = 0;
+	pipeline->printed = 0;
+	DIE(sem_init(&pipeline->completed, 0, 0) < 0, "sem_init failed");
+	return pipeline;
+}
+
+void pipeline_free(request_pipeline *pipeline)
+{
+	for (unsigned int i = 0; i < pipeline->capacity; i++)
+		output_memory_free(&pipeline->slots[i].out);
+	sem_destroy(&pipeline->completed);
+	free(pipeline->slots);
+	free(pipeline);
+}
+
+/**
+ * pipeline_print_oldest() - Waits for the oldest request in flight, copies
+ * its responses to the standard output and frees its slot.
+ */
+static void pipeline_print_oldest(request_pipeline *pipeline)
+{
+	request_slot *slot =
+	&pipeline->slots[pipeline->printed % pipeline->capacity];
+
+	/**
+	 * every completion posts the semaphore once, so waiting on it until this
+	 * slot is done may consume the posts of later slots; their flags are
+	 * already set when their turn comes
+	 **/
+	while (!__atomic_load_n(&slot->done, __ATOMIC_ACQUIRE))
+		while (sem_wait(&pipeline->completed) < 0)
+			;
+
+	output_write(output_stdout(), slot->out.buffer, slot->out.length);
+	if (slot->free_name)
+		free(slot->req.key.name);
+	pipeline->printed++;
+}
+
+static request_slot *pipeline_reserve(request_pipeline *pipeline)
+{
+	if (pipeline->posted - pipeline->printed == pipeline->capacity)
+		pipeline_print_oldest(pipeline);
+
+	request_slot *slot =
+	&pipeline->slots[pipeline->posted % pipeline->capacity];
+	slot->done = 0;
+	slot->free_name = false;
+	output_clear(&slot->out);
+	pipeline->posted++;
+	return slot;
+}
+
+void pipeline_post(request_pipeline *pipeline, server_worker *worker,
+				   request *req, bool free_name)
+{
+	request_slot *slot = pipeline_reserve(pipeline);
+	slot->req = *req;
+	slot->free_name = free_name;
+	worker->posted++;
+
+	mpsc_push(&worker->inbox, &slot->link);
+	sem_post(&worker->pending);
+}
+
+void pipeline_begin(request_pipeline *pipeline)
+{
+	request_slot *slot = pipeline_reserve(pipeline);
+	output_set_current(&slot->out);
+}
+
+void pipeline_end(request_pipeline *pipeline)
+{
+	request_slot *slot =
+	&pipeline->slots[(pipeline->posted - 1) % pipeline->capacity];
+	output_set_current(NULL);
+	__atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+}
+
+void pipeline_complete(request_pipeline *pipeline)
+{
+	while (pipeline->printed < pipeline->posted)
+		pipeline_print_oldest(pipeline);
+}
+
+static void worker_handle(server_worker *worker, request_slot *slot)
+{
+	server_t *server = worker->server;
+	response res;
+
+	output_set_current(&slot->out);
+	server_wait_drain(server);
+	server->handler_replica = slot->req.replica_index;
+	if (server_handle_request(server, &slot->req, &res))
+		print_response(&res);
+	blob_release(slot->req.doc_content);
+	slot->req.doc_content = NULL;
+
+	__atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&worker->handled, 1, __ATOMIC_RELEASE);
+	sem_post(&worker->pipeline->completed);
+}
+
+static void *worker_run(void *arg)
+{
+	server_worker *worker = arg;
+
+	for (;;)
+	{
+		while (sem_wait(&worker->pending) < 0)
+			;
+
+		mpsc_node *node;
+		while (!(node = mpsc_pop(&worker->inbox)))
+			sched_yield();
+
+		if (node == &worker->stop)
+			break;
+		worker_handle(worker, (request_slot *)node);
+	}
+
+	return NULL;
+}
+
+server_worker *worker_start(server_t *server, request_pipeline *pipeline)
+{
+	server_worker *worker = malloc(sizeof(server_worker));
+	DIE(!worker, "malloc failed");
+
+	mpsc_init(&worker->inbox);
+	DIE(sem_init(&worker->pending, 0, 0) < 0, "sem_init failed");
+	worker->server = server;
+	worker->pipeline = pipeline;
+	worker->posted = 0;
+	worker->handled = 0;
+	DIE(pthread_create(&worker->thread, NULL, worker_run, worker),
+		"pthread_create failed");
+	return worker;
+}
+
+void worker_quiesce(server_worker *worker)
+{
+	/**
+	 * only the main thread waits, so a completion consumed here is never
+	 * missed by pipeline_print_oldest(), which checks the flags first
+	 **/
+	while (__atomic_load_n(&worker->handled, __ATOMIC_ACQUIRE) != worker->posted)
+		while (sem_wait(&worker->pipeline->completed) < 0)
+			;
+}
+
+void worker_stop(server_worker *worker)
+{
+	mpsc_push(&worker->inbox, &worker->stop);
+	sem_post(&worker->pending);
+	pthread_join(worker->thread, NULL);
+	sem_destroy(&worker->pending);
+	free(worker);
+}
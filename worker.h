@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2024, <>
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include "output.h"
+#include "server.h"
+
+/**
+ * Intrusive multi-producer, single-consumer queue without locks. Producers
+ * exchange the head with their node and then link the previous head to it;
+ * the consumer follows the links from the tail. A stub node keeps the queue
+ * from ever being empty, so the two ends never have to be updated together.
+ */
+typedef struct mpsc_node mpsc_node;
+struct mpsc_node {
+    mpsc_node *next;
+};
+
+typedef struct mpsc_queue {
+    mpsc_node *head;
+    mpsc_node *tail;
+    mpsc_node stub;
+} mpsc_queue;
+
+void mpsc_init(mpsc_queue *queue);
+
+void mpsc_push(mpsc_queue *queue, mpsc_node *node);
+
+/**
+ * mpsc_pop() - Removes the oldest node. Only the consumer may call it.
+ *
+ * @return - The node, or NULL if the queue is empty or if the oldest node's
+ *      producer has not linked it yet.
+ */
+mpsc_node *mpsc_pop(mpsc_queue *queue);
+
+/**
+ * A request posted to the worker of its server. The worker handles it,
+ * prints its responses, the ones of the tasks it drains included, in the
+ * slot's memory sink, releases the content and marks the slot as done.
+ */
+typedef struct request_slot {
+    mpsc_node link;
+    request req;
+    bool free_name;
+    output_sink out;
+    int done;
+} request_slot;
+
+/**
+ * Ring of the posted requests, in input order. The responses of a request
+ * are copied to the standard output only after the ones of every earlier
+ * request, so the output is the same as in a single threaded run.
+ */
+typedef struct request_pipeline {
+    request_slot *slots;
+    unsigned int capacity;
+    unsigned long long posted;
+    unsigned long long printed;
+    sem_t completed;
+} request_pipeline;
+
+/**
+ * Thread serving one server: it is the only thread touching the server
+ * while requests are in flight.
+ */
+typedef struct server_worker {
+    pthread_t thread;
+    mpsc_queue inbox;
+    sem_t pending;
+    mpsc_node stop;
+    server_t *server;
+    request_pipeline *pipeline;
+    // requests posted to the worker and handled by it so far
+    unsigned long long posted;
+    unsigned long long handled;
+} server_worker;
+
+request_pipeline *pipeline_create(unsigned int capacity);
+
+/**
+ * pipeline_free() - Frees a pipeline without requests in flight.
+ */
+void pipeline_free(request_pipeline *pipeline);
+
+/**
+ * pipeline_post() - Posts a request to a worker, first printing the oldest
+ * request if all the slots are in flight.
+ *
+ * @param req: The routed request. The worker takes its content reference.
+ * @param free_name: Whether the name is freed once the request completes.
+ */
+void pipeline_post(request_pipeline *pipeline, server_worker *worker,
+                   request *req, bool free_name);
+
+/**
+ * pipeline_begin() - Takes the next slot for the responses the calling
+ * thread prints until pipeline_end(), so they are copied to the standard
+ * output after the ones of the requests posted before.
+ */
+void pipeline_begin(request_pipeline *pipeline);
+
+void pipeline_end(request_pipeline *pipeline);
+
+/**
+ * pipeline_complete() - Waits for every request in flight and prints their
+ * responses, in posting order. Afterwards no worker touches its server
+ * until the next post.
+ */
+void pipeline_complete(request_pipeline *pipeline);
+
+server_worker *worker_start(server_t *server, request_pipeline *pipeline);
+
+/**
+ * worker_quiesce() - Waits for the requests posted to a worker. Afterwards
+ * the worker does not touch its server until the next post.
+ */
+void worker_quiesce(server_worker *worker);
+
+/**
+ * worker_stop() - Stops and joins a worker without requests in flight.
+ */
+void worker_stop(server_worker *worker);
+
+#endif /* WORKER_H */